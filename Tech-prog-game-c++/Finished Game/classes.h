@@ -3,26 +3,73 @@
 #include <memory>
 #include <cstddef>
 #include <set>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <iosfwd>
 #include "gtest/gtest_prod.h"
 
 const int boardSize = 8;
 const int maxCompositeDepth = 3;
-const int attackingUnits = 1; // без учёта короля
-const int defendingUnits = 1; // без учёта короля
+const int attackingUnits = 3; // без учёта короля
+const int defendingUnits = 3; // без учёта короля
+const int maxBoardSide = 4096; // boards over boardSize are CPlayingBoard only, the rules engine keeps to 64 squares
+
+struct CGameConfig { // a variant of the game, the defaults above unless set from the command line or a file
+    int boardSide;
+    int units[2]; // per fraction, the leader not counted
+
+    CGameConfig();
+    bool set(const std::string&, int); // "size", "attacking_units" or "defending_units", false if unknown or invalid
+    bool fits() const; // both armies with their leaders fit on the board
+};
+
+bool readConfig(std::istream&, CGameConfig&); // "key value" lines, '#' starts a comment
 
 std::vector<std::string> structureNames{"Army", "Squad", "Soldier"}; // names of the levels, size should be equal to maxCompositeDepth
 
 class CUnit;
 class CPlayingBoard;
+class CBattle;
 class CVisitor;
 class CNode;
 
 enum fraction {defending, attacking};
 enum warriorType {leader, infantry, shooter};
+enum gamePhase {placementPhase, editCompositePhase, movePhase, attackPhase, finishedPhase};
+enum actionType {placeAction, addStructureAction, switchChildAction, endEditAction, moveAction, attackAction, passAction};
 
 bool betweenBorders(int, int, int, int, int, int);
 
-bool insideBattleField(int, int, std::shared_ptr<std::vector<std::vector<CUnit*> > >);
+struct CReach { // Manhattan distances a unit can move or attack to, an empty range if min > max
+    int minDistance;
+    int maxDistance;
+};
+
+struct CUnitStats {
+    int health;
+    int damage;
+    CReach move;
+    CReach attack;
+};
+
+// indexed by [fraction][warriorType], the reach must agree with the units' canMove/canAttack
+constexpr CUnitStats unitStats[2][3] = {{{1, 0, {1, 1}, {1, 0}}, {1, 2, {1, 2}, {1, 1}}, {1, 2, {1, 1}, {1, 4}}},
+                                        {{6, 2, {1, 2}, {1, 4}}, {2, 2, {1, 2}, {1, 1}}, {1, 1, {1, 1}, {1, 4}}}};
+
+struct CUnitData { // a unit as the board stores it
+    uint8_t fraction;
+    uint8_t type;
+    int16_t health;
+    int32_t square;
+};
+
+bool insideBattleField(int, int, std::shared_ptr<const std::vector<std::vector<CUnit*> > >);
 
 class CArmyFactory {
 public:
@@ -64,6 +111,7 @@ private:
     friend class CComposite;
 public:
     CUnit(int, int, fraction, warriorType);
+    CUnit(fraction, warriorType);
     virtual ~CUnit() = default;
     CUnit(const CUnit&);
     CUnit& operator= (const CUnit&);
@@ -152,32 +200,225 @@ public:
 };
 
 class CComposite;
+struct CAction;
+class CGameState;
+class CUndoStack;
+
+const int ringSide = 2 * boardSize - 1; // offsets of a move lie in (-boardSize, boardSize)
+const int healthBuckets = 8; // health values the position hash tells apart, larger ones share the last bucket
+const size_t maxGeneratedMoves = 512;
+const int winScore = 1000000; // evaluation of a won game, every other position scores strictly between -winScore and winScore
+
+class CBitBoard {
+private:
+    uint64_t fractionMask_[2];
+    uint64_t typeMask_[3];
+    CUnitData units_[boardSize * boardSize]; // indexed by unit id
+    int8_t unitAt_[boardSize * boardSize];   // unit id on the square, -1 if empty
+    uint64_t aliveUnits_;                    // ids in use
+    uint64_t attackers_[2]; // units of the fraction with an enemy in reach
+    uint64_t targets_[2];   // enemy units the fraction can hit
+    uint8_t threats_[2][boardSize * boardSize]; // units of the fraction which can hit the square
+    uint64_t threatMap_[2]; // squares with a threat count over zero
+    uint64_t hash_;         // Zobrist hash of the units, kept up to date by every mutator
+    uint64_t playable_;     // squares of a board with a side under boardSize, the rest of the grid stays empty
+    int side_;
+
+    uint64_t unitKey(int) const;
+    void addThreats(const CUnitData&, int); // adds the unit's attack ring to the counts, or takes it away
+    void refreshUnit(int);
+    void refreshAround(uint64_t);
+    uint64_t generateNodeMoves(const CComposite&, int, bool&, CAction*, size_t, size_t&) const;
+    void addSquadMoves(std::pair<int, int>, uint64_t, CAction*, size_t, size_t&) const;
+    bool squadFits(uint64_t, int, int) const; // the squad's squares shifted are on the board and free
+public:
+    explicit CBitBoard(int = boardSize); // the side, at most boardSize
+    ~CBitBoard() = default;
+
+    static int square(int, int);
+    static uint64_t squareMask(int, int);
+    static uint64_t shiftMask(uint64_t, int, int); // squares pushed off the boardSize grid are dropped
+    static bool inside(int, int); // on the boardSize grid, onBoard also checks the side
+    bool onBoard(int, int) const;
+    int side() const;
+    uint64_t playable() const;
+    static uint64_t nodeMask(const CComposite&, int);
+
+    uint64_t occupied() const;
+    uint64_t fractionMask(fraction) const;
+    uint64_t typeMask(warriorType) const;
+    bool isOccupied(int, int) const;
+    fraction getFraction(int, int) const;
+    warriorType getWarriorType(int, int) const;
+    int getHealth(int, int) const;
+    int unitAt(int, int) const;
+    const CUnitData& unit(int) const;
+    uint64_t aliveUnits() const;
+    uint64_t hash() const;
+    uint64_t computeHash() const; // the same hash rebuilt from scratch
+
+    bool canPlaceUnit(int, int) const;
+    bool canMove(int, int, int, int) const;
+    bool canAttack(int, int, int, int) const;
+    bool canAttack(int, int) const;
+    uint64_t attackers(fraction) const;
+    uint64_t targets(fraction) const;
+    uint64_t targetsOf(int, int) const;
+    int threatCount(fraction, int, int) const; // units of the fraction which can hit the square
+    uint64_t threatMap(fraction) const;
+    bool leaderInDanger() const; // the defending leader is in reach of an attacking unit
+    bool canMoveComposite(const CComposite&, std::pair<int, int>, int, int) const;
+    bool canMoveSquad(uint64_t, int, int) const; // the same check for the squares of a node, from nodeMask
+    size_t generateMoves(const CComposite&, CAction*, size_t) const;
+
+    void placeUnit(int, int, fraction, warriorType, int);
+    void restoreUnit(int, const CUnitData&); // puts a removed unit back under its old id
+    void removeUnit(int, int);
+    void reduceHealth(int, int, int);
+    void attack(int, int, int, int);
+    void moveComposite(CComposite&, std::pair<int, int>, int, int);
+    void moveSquad(CComposite&, int, uint64_t, int, int); // the node and its nodeMask, already checked
+    void clear();
+    void printBoard() const;
+};
+
+const CUnit* unitPrototype(fraction, warriorType);
 
-class CPlayingBoard {
+const int tileSide = boardSize; // a classic board is a single tile
+
+template <typename T>
+class CTiledGrid { // a square grid cut into tiles, a tile is allocated by the first write into it
 private:
-    static bool canPlaceUnit(int, int);
-    static bool canMove(int, int, int, int);
-    static bool canMoveComposite(const CComposite&, std::pair<int, int>, int, int);
-    static bool canAttack(int, int, int, int);
-    static bool canAttack(int, int);
+    std::vector<std::vector<T> > tiles_; // an empty tile holds only empty_ values
+    int side_;
+    int tilesPerRow_;
+    T empty_;
+
+    size_t tile(int, int) const;
+    static int cell(int, int);
+public:
+    explicit CTiledGrid(int = 0, const T& = T());
+    ~CTiledGrid() = default;
+
+    int side() const;
+    const T& get(int, int) const; // the coordinates must be on the grid
+    T& at(int, int);              // allocates the tile of the cell
+    void set(int, int, const T&); // writing the empty value allocates nothing
+    size_t allocatedTiles() const;
+    template <typename Visitor>
+    void forEach(Visitor) const;  // every cell which is not empty, with its coordinates
+    void clear();
+};
+
+const int bucketSide = 4; // the longest reach, a query of that radius looks at 3 x 3 buckets at most
+
+class CSpatialIndex { // the units of each fraction in buckets of bucketSide x bucketSide squares
+private:
+    struct CEntry {
+        int x;
+        int y;
+        fraction owner;
+        int prev; // links of the bucket's list
+        int next;
+    };
+
+    std::vector<CEntry> entries_;
+    std::vector<int> freeEntries_;
+    CTiledGrid<int> heads_[2]; // the first entry of every bucket, -1 if it is empty
+    CTiledGrid<int> entryAt_;  // the entry of the unit on every square
+    size_t size_;
+public:
+    explicit CSpatialIndex(int = 0);
+    ~CSpatialIndex() = default;
+
+    void add(int, int, fraction);
+    void remove(int, int);
+    size_t size() const;
+    template <typename Visitor>
+    void forEachInRadius(fraction, int, int, int, Visitor) const; // units of the fraction within a Manhattan radius
+};
+
+class CLargeBoard { // a board with more squares than a mask has bits, queries look at the cells around a unit
+protected:
+    CSpatialIndex index_; // kept by the derived boards as units are placed, moved and removed
+    CTiledGrid<uint8_t> threats_[2]; // units of the fraction which can hit the square, kept the same way
+    std::pair<int, int> leaders_[2]; // (-1, -1) without a leader
+
+    static void shiftNodes(CComposite&, int, int, int); // CComposite lets only the boards move its nodes
+    void addThreats(int, int, fraction, warriorType, int); // the unit's attack ring, added or taken away
+public:
+    explicit CLargeBoard(int);
+    virtual ~CLargeBoard() = default;
+
+    const CSpatialIndex& index() const;
+    int threatCount(fraction, int, int) const;
+    bool leaderInDanger() const;
+
+    virtual int side() const = 0;
+    virtual bool isOccupied(int, int) const = 0;
+    virtual fraction getFraction(int, int) const = 0;
+    virtual warriorType getWarriorType(int, int) const = 0;
+    virtual bool canPlaceUnit(int, int) const = 0;
+    virtual bool canMove(int, int, int, int) const = 0;
+    virtual bool canAttack(int, int, int, int) const = 0;
+    virtual bool canAttack(int, int) const = 0;
+    virtual bool canMoveComposite(const CComposite&, std::pair<int, int>, int, int) const = 0;
+    virtual void placeUnit(int, int, fraction, warriorType) = 0;
+    virtual void removeUnit(int, int) = 0;
+    virtual void moveSquad(CComposite&, int, int, int) = 0; // the node, already checked with canMoveComposite
+    void moveComposite(CComposite&, std::pair<int, int>, int, int);
+};
 
-    static std::shared_ptr<std::vector<std::vector<CUnit*> > > desk_;
+std::unique_ptr<CLargeBoard> makeLargeBoard(int); // code fixed at compile time for sides 16 and 32, generic otherwise
+
+class CPlayingBoard { // owns the units placed on it, every game or simulation can have its own
+private:
+    bool canPlaceUnit(int, int) const;
+    bool canMove(int, int, int, int) const;
+    bool canMoveComposite(const CComposite&, std::pair<int, int>, int, int) const;
+    bool canAttack(int, int, int, int) const;
+    bool canAttack(int, int) const;
+
+    int side_;
+    std::shared_ptr<std::vector<std::vector<CUnit*> > > desk_;
+    CBitBoard bits_; // mirrors desk_ up to boardSize and answers every query with mask operations
+    std::unique_ptr<CLargeBoard> large_; // answers the queries instead on larger boards
+    CTiledGrid<CUnit*> units_;           // the units of a larger board, it has no desk_
+    std::vector<std::pair<std::pair<int, int>, CUnit*> > moving_; // reused by moveComposite
+
+    CUnit*& cell(int, int); // std::logic_error after deleteBoard until board() is called again
 
     friend class CGame;
+    friend class CBattle;
 public:
-    CPlayingBoard() = delete;
+    explicit CPlayingBoard(int = boardSize); // the side, std::invalid_argument outside 1 to maxBoardSide
     ~CPlayingBoard();
     CPlayingBoard(const CPlayingBoard&) = delete;
     CPlayingBoard& operator=(const CPlayingBoard&) = delete;
 
-    static std::shared_ptr<std::vector<std::vector<CUnit*> > > board();
-    static void moveComposite(int, int, int, int, CComposite);
-    static bool allMovedComposite(std::shared_ptr<CNode>, int);
-    static bool allUnmovedComposite(std::shared_ptr<CNode>);
-    static void placeUnit(int, int, CUnit*);
-    static void attack(int, int, int, int);
-    static void deleteBoard();
-    static void printBoard();
+    static CPlayingBoard& current();        // the board of this thread, for code written against one shared board
+    static void setCurrent(CPlayingBoard*); // nullptr gives the thread its own board back
+
+    // read only, the squares change through placeUnit, removeUnit and attack, which keep bits_ in step;
+    // an empty one is made after deleteBoard, nullptr on boards over boardSize
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board();
+    int side() const;
+    const CUnit* unitAt(int, int) const; // nullptr for an empty square
+    template <typename Visitor>
+    void forEachUnit(Visitor) const;     // only the occupied squares, in no particular order
+    void enemiesInRadius(int, int, int, std::vector<std::pair<int, int> >&) const; // of the unit on the square
+    int threatCount(fraction, int, int) const; // units of the fraction which can hit the square
+    bool leaderInDanger() const;               // the defending leader is in reach of an attacking unit
+    void moveComposite(int, int, int, int, CComposite&);
+    static bool allMovedComposite(const CComposite&, int, int);
+    static bool allUnmovedComposite(const CComposite&, int);
+    const CBitBoard& bitBoard() const;
+    void placeUnit(int, int, CUnit*);
+    void removeUnit(int, int);
+    void attack(int, int, int, int);
+    void reduceHealth(int, int, int);
+    void deleteBoard();
+    void printBoard() const;
 };
 
 class CFactoryDecorator: public CArmyFactory {
@@ -193,51 +434,88 @@ public:
 };
 
 
-class CNode {
+class CNode { // an element of the composite's arena, links are indices in it
 private:
-    int depth_; // top depth = 1
-    std::vector<std::shared_ptr<CNode> > children_;
+    int depth_; // top depth = 1, 0 for a free slot
     std::pair<int, int> savedComponent_;
-    bool moveOnTheIteration;
+    unsigned movedTurn_;   // the composite's turn the soldier last moved on
+    int soldiers_;         // soldiers in the subtree, the node included
+    int moved_;            // those of them which moved on countedTurn_
+    unsigned countedTurn_; // moved_ is zero on any other turn, so a new turn needs no pass over the nodes
+    int parent_; // -1 if absent
+    int firstChild_;
+    int lastChild_;
+    int prevSibling_;
+    int nextSibling_;
+
+    friend class CComposite;
 public:
     CNode(int, int, int);
     ~CNode() = default;
 
-    bool addChild(int, int);
-    bool removeChild(int, int);
     std::pair<int, int> getSavedComponent() const;
-    std::shared_ptr<CNode> getNode(int, int) const;
-    std::shared_ptr<CNode> getParentNode(int, int, std::shared_ptr<CNode>) const;
-
-    friend class CComposite;
-    friend class CPlayingBoard;
-};
-
-bool operator <(const std::shared_ptr<CNode>&, const std::shared_ptr<CNode>&);
-
-struct CComparator {
-public:
-    bool operator ()(const std::shared_ptr<CNode>&, const std::shared_ptr<CNode>&);
+    int getDepth() const;
+    int getParent() const;
+    int getFirstChild() const;
+    int getLastChild() const;
+    int getPrevSibling() const;
+    int getNextSibling() const;
 };
 
 class CComposite {
 private:
-    std::shared_ptr<CNode> topNode_;
+    std::vector<CNode> nodes_; // the army is node 0
+    std::vector<int> freeNodes_;
+    std::vector<int> structureAt_; // node of every structure number, -1 if the number is free
+    CTiledGrid<int> soldierAt_;    // node of the soldier on every square, -1 if none
     fraction fraction_;
-    std::set<int> usedNumbers_;
+    unsigned turn_;      // startNewMove begins the next one
+    uint64_t movedMask_; // squares of the soldiers moved on the turn, kept on boards up to boardSize
+    uint64_t hash_;      // the parent links, kept up to date as nodes are linked, unlinked and moved
+
+    uint64_t linkKey(int) const;
+    void build(const CBitBoard&);
+    void build(const CPlayingBoard&);
+    int allocateNode(int, int, int);
+    void linkChild(int, int, int);
+    void unlinkNode(int);
+    int movedIn(int) const;
+    void addCounts(int, int, int);
+    uint64_t squareBit(int, int) const;
+    void markMoved(int);
+    void relinkNode(int, int, int);
+    int restoreNode(int, int, int, int);
+    void restoreMoved(uint64_t);
+    bool canAdopt(int, int) const;
+    int addNode(int, int, int);
+    bool removeNode(int);
+    void moveNode(int, int, int);
+
+    friend class CBitBoard;
+    friend class CLargeBoard;
+    friend void unmakeAction(CGameState&, CUndoStack&);
 public:
-    CComposite(fraction);
+    CComposite(fraction, const CPlayingBoard&);
+    CComposite(fraction, const CBitBoard&);
     ~CComposite() = default;
 
     void printComposite() const;
     void startNewMove();
-    std::shared_ptr<CNode> getTopNode() const;
-    std::shared_ptr<CNode> getNode(int, int) const;
-    std::shared_ptr<CNode> getParentNode(int, int) const;
+    int getTopNode() const;
+    const CNode& node(int) const;
+    int nextInSubtree(int, int) const; // preorder successor inside the subtree, -1 after its last node
+    bool isMoved(int) const;    // the soldier moved on this turn
+    bool allMoved(int) const;   // every soldier of the subtree did
+    bool allUnmoved(int) const; // none of them did
+    int getNode(int, int) const;
+    int getParentNode(int, int) const;
     bool addChild(int);
     bool removeChild(int, int);
     bool switchChild(int, int, int);
-    size_t size() const;
+    size_t size() const; // live soldiers, counted as they are linked and unlinked
+    uint64_t movedSoldiers() const; // squares of the soldiers moved on the iteration, boards up to boardSize only
+    uint64_t hash() const;          // the grouping: which structure every node belongs to
+    uint64_t computeHash() const;   // the same hash rebuilt from scratch
 };
 
 class CVisitor {
@@ -253,28 +531,381 @@ public:
     void visit(CAttackingLeader) const;
 };
 
-class CGame {
+struct CAction {
+    actionType type;
+    int x, y;             // placed square, moved node or attacking unit
+    int targetX, targetY; // offset of a move or square of the attacked unit
+    int number;           // warriorType to place or structure number to edit
+
+    CAction(actionType = passAction, int = 0, int = 0, int = 0, int = 0, int = 0);
+};
+
+bool operator ==(const CAction&, const CAction&);
+
+class CGameState {
 private:
-    bool gameFinished;
+    CBitBoard board_;
+    CComposite attackingComposite_;
+    CComposite defendingComposite_;
+    gamePhase phase_;
+    fraction toMove_;
+    fraction winner_;
+    CGameConfig config_;
+    int placedUnits_; // units of toMove_ placed so far, the leader goes first
+    int attackCursor_; // square of the unit which attacks next
+
+    CComposite& editableComposite(fraction);
+    bool buildsComposites() const; // the next placement completes both armies
+    void finishPlacement();
+    void finishMovePhase();
+    void nextAttacker();
+    void play(const CAction&);
+
+    friend bool applyAction(CGameState&, const CAction&);
+    friend bool makeAction(CGameState&, const CAction&, CUndoStack&);
+    friend void unmakeAction(CGameState&, CUndoStack&);
+public:
+    explicit CGameState(const CGameConfig& = CGameConfig()); // std::invalid_argument for a side over boardSize
+    ~CGameState() = default;
+
+    const CBitBoard& board() const;
+    const CGameConfig& config() const;
+    const CComposite& composite(fraction) const;
+    gamePhase phase() const;
+    fraction toMove() const;
+    fraction winner() const;
+    int placedUnits() const;
+    std::pair<int, int> attacker() const;
+    uint64_t hash() const;
+};
+
+bool isLegalAction(const CGameState&, const CAction&);
+bool applyAction(CGameState&, const CAction&);
+std::vector<CAction> legalActions(const CGameState&);
+void legalActions(const CGameState&, std::vector<CAction>&); // refills the vector, keeping its capacity
+bool isTerminal(const CGameState&);
+int evaluate(const CGameState&, fraction); // leader safety, material and mobility, positive is good for the fraction
+
+struct CUndoRecord { // what unmakeAction needs to take an action back
+    CAction action;
+    gamePhase phase;
+    fraction toMove;
     fraction winner;
+    int placedUnits;
+    int attackCursor;
+    int node;        // the added structure, the switched soldier or the killed unit's node
+    int parent;      // old place of the switched or killed node
+    int prevSibling;
+    int unitId;      // the attacked unit as it was before the attack
+    CUnitData unit;
+    uint64_t moved[2]; // movedSoldiers() of both composites before a phase could reset them
+    std::vector<CComposite> composites; // by fraction, before the placement which rebuilt them, empty otherwise
+};
+
+class CUndoStack { // records are preallocated and reused, the stack only grows past its capacity
+private:
+    std::vector<CUndoRecord> records_;
+    size_t size_;
+
+    CUndoRecord& push();
+    const CUndoRecord& pop();
+
+    friend bool makeAction(CGameState&, const CAction&, CUndoStack&);
+    friend void unmakeAction(CGameState&, CUndoStack&);
+public:
+    explicit CUndoStack(size_t = 1024);
+    ~CUndoStack() = default;
 
-    CArmyFactory* attackingFactory;
-    CArmyFactory* defendingFactory;
-    CComposite attackingComposite;
-    CComposite defendingComposite;
+    size_t size() const;
+    void clear();
+};
 
+bool makeAction(CGameState&, const CAction&, CUndoStack&); // applyAction which can be taken back
+void unmakeAction(CGameState&, CUndoStack&);               // takes back the last made action
+
+class CPlayer {
+public:
+    CPlayer() = default;
+    virtual ~CPlayer() = default;
+
+    virtual CAction chooseAction(const CGameState&) = 0; // a legal action for the side to move
+};
+
+enum boundType {exactBound, lowerBound, upperBound};
+
+struct CTableHit {
+    int depth;
+    boundType bound;
+    int score;  // for the attacking fraction
+    int action; // index of the best action in legalActions order, -1 if unknown
+};
+
+class CTranspositionTable { // shared by search threads without locks, torn entries fail the XOR check
+private:
+    struct CEntry {
+        std::atomic<uint64_t> check; // hash ^ data
+        std::atomic<uint64_t> data;
+    };
+
+    static const int bucketSize = 4; // a bucket is one cache line
+    std::vector<CEntry> entries_;
+    uint64_t bucketMask_;
+
+    static uint64_t pack(int, boundType, int, int);
+public:
+    explicit CTranspositionTable(size_t); // entries, rounded up to a power of two
+    ~CTranspositionTable() = default;
+
+    bool probe(uint64_t, CTableHit&) const;
+    void store(uint64_t, int, boundType, int, int);
+    void clear();
+    size_t size() const;
+};
+
+class CAlphaBetaPlayer: public CPlayer {
+private:
+    int depth_;         // in actions, a side often takes several in a row
+    size_t nodeBudget_; // 0 means unlimited, nodes past the budget are evaluated statically
+    size_t nodes_;
+    int lastScore_;
+    fraction player_;
+    CTranspositionTable* table_; // not owned, may be shared with other players
+    const std::atomic<bool>* stop_; // raised by another thread to cut the search short
+    int timeBudget_;                // milliseconds per action, 0 searches to the full depth
+    std::chrono::steady_clock::time_point deadline_;
+    bool timeUp_;
+    bool completed_; // the last searchRoot saw every root action through without being aborted
+    int lastDepth_;
+    double lastSeconds_, longestSeconds_, totalSeconds_;
+    int moves_;
+    CUndoStack stack_;
+    std::vector<std::vector<CAction> > actions_; // reused action lists, one per ply
+
+    static void searchActions(const CGameState&, std::vector<CAction>&);
+    int search(CGameState&, int, int, int, int);
+    CAction searchRoot(CGameState&, int);
+    bool stopped(); // past a budget or told to stop, nodes are then evaluated statically
+    bool aborted(); // past the deadline or told to stop, the iteration is thrown away and siblings are skipped
+    bool interrupted() const; // aborted() without reading the clock
+
+    friend class CLazySmpPlayer;
+public:
+    CAlphaBetaPlayer(int = 3, size_t = 0, CTranspositionTable* = nullptr);
+    ~CAlphaBetaPlayer() override = default;
+
+    CAction chooseAction(const CGameState&) override;
+    void setTimeBudget(int); // in milliseconds, the depth given to the constructor becomes the limit
+    size_t nodes() const;    // visited by the last chooseAction
+    int lastScore() const;   // value of the chosen action for the side which moved
+    int lastDepth() const;   // of the last completed iteration
+    double lastSeconds() const;
+    double longestSeconds() const;
+    double totalSeconds() const;
+    int moves() const; // chooseAction calls so far
+};
+
+class CLazySmpPlayer: public CPlayer { // threads search the same root and share one table
+private:
+    CTranspositionTable* table_;
+    std::unique_ptr<CTranspositionTable> ownTable_; // used when no table is given
+    std::vector<CAlphaBetaPlayer> searchers_;      // one per thread, the first one answers
+    std::vector<double> seconds_;
+    std::atomic<bool> stop_;
+
+    void runSearcher(const CGameState&, int);
+public:
+    CLazySmpPlayer(int = 3, int = 1, CTranspositionTable* = nullptr, size_t = 1 << 20);
+    ~CLazySmpPlayer() override = default;
+
+    CAction chooseAction(const CGameState&) override;
+    int threads() const;
+    size_t nodes(int) const; // of one thread in the last chooseAction
+    size_t totalNodes() const;
+    double seconds(int) const;
+    double nodesPerSecond(int) const;
+    int lastScore() const;
+};
+
+std::vector<CGameState> searchSuite(size_t, uint64_t); // positions in the move phase for benchmarks
+
+struct CMctsNode {
+    CAction action; // taken by mover to get here
+    fraction mover;
+    int parent;
+    int firstChild; // children are contiguous in the pool
+    int childCount; // -1 until expanded
+    int visits;
+    double wins;    // for mover, a draw counts as a half
+};
+
+class CMctsTree { // one UCT search on its own node pool, allocated once and reused for every move
+private:
+    std::vector<CMctsNode> pool_;
+    size_t used_;
+    uint64_t seed_;
+    int maxPlayout_;
+    CUndoStack stack_;
+    std::vector<CAction> actions_;
+
+    void searchActions(const CGameState&);
+    int selectChild(int, double) const;
+    bool expand(int, const CGameState&);
+    double playout(CGameState&); // 1 if the attacking fraction wins
+public:
+    CMctsTree(size_t, uint64_t, int);
+    ~CMctsTree() = default;
+
+    void search(const CGameState&, int, double);
+    const CMctsNode& node(int) const;
+    size_t used() const;
+};
+
+class CMctsPlayer: public CPlayer {
+private:
+    int iterations_; // per thread
+    double exploration_;
+    std::vector<CMctsTree> trees_; // one per thread, root parallelism
+public:
+    CMctsPlayer(int = 2000, int = 1, size_t = 1 << 16, int = 300, double = 1.4);
+    ~CMctsPlayer() override = default;
+
+    CAction chooseAction(const CGameState&) override;
+    const CMctsTree& tree(int) const;
+    int threads() const;
+};
+
+bool playMatch(CGameState&, CPlayer&, CPlayer&, int); // true if the game finished within the number of actions
+
+class CRandomPlayer: public CPlayer { // ends the composite editing at once, as the search players do
+private:
+    uint64_t seed_;
+    std::vector<CAction> actions_;
+public:
+    explicit CRandomPlayer(uint64_t = 1);
+    ~CRandomPlayer() override = default;
+
+    CAction chooseAction(const CGameState&) override;
+};
+
+class CGreedyPlayer: public CPlayer { // the action with the best static evaluation, the first one on ties
+private:
+    CUndoStack stack_;
+    std::vector<CAction> actions_;
+public:
+    CGreedyPlayer() = default;
+    ~CGreedyPlayer() override = default;
+
+    CAction chooseAction(const CGameState&) override;
+};
+
+class CWorkStealingPool { // every worker runs its own queue from the back and steals from the front of others
+private:
+    struct CQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    std::vector<std::unique_ptr<CQueue> > queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_;  // waiting in the queues
+    std::atomic<size_t> pending_; // submitted and not finished
+    std::atomic<size_t> next_;    // queue for the next task submitted from outside
+    std::atomic<size_t> stolen_;
+    bool done_;
+    std::mutex idleMutex_;
+    std::condition_variable idle_, finished_;
+
+    bool takeTask(int, std::function<void()>&);
+    void work(int);
+public:
+    explicit CWorkStealingPool(int);
+    ~CWorkStealingPool(); // runs the queued tasks first
+    CWorkStealingPool(const CWorkStealingPool&) = delete;
+    CWorkStealingPool& operator=(const CWorkStealingPool&) = delete;
+
+    void submit(std::function<void()>); // from a worker the task goes to its own queue
+    void wait();                         // until every submitted task has finished
+    int threads() const;
+    size_t stolen() const;
+};
+
+class CPhaseObserver {
+public:
+    CPhaseObserver() = default;
+    virtual ~CPhaseObserver() = default;
+
+    virtual void onPhaseChange(gamePhase, fraction, gamePhase, fraction) = 0; // old phase and side, then the new ones
+};
+
+class CGame {
+private:
+    CGameState state_;
+    std::vector<CPhaseObserver*> observers_; // not owned
+    CPlayer* players_[2];                    // not owned, nullptr for a human at std::cin
+
+    bool play(const CAction&);
+    void makeBotAction(fraction);
     std::pair<int, int> tryPlaceUnit() const;
     void placeLeader(fraction);
-    void placeUnit(fraction, int);
+    void placeUnit(fraction);
     void makeMove(fraction);
-    void makeMovePhase(fraction);
-    void makeAttack(fraction);
-    void makeAttackPhase(fraction);
-    void placeArmy();
-    void makeEditCompositePhase(fraction);
+    void makeAttack();
     void makeEditComposite(fraction);
+
 public:
-    CGame();
-    ~CGame();
+    explicit CGame(const CGameState& = CGameState()); // the position the game goes on from, a new game by default
+    ~CGame() = default;
+
+    void addObserver(CPhaseObserver*);
+    void setPlayer(fraction, CPlayer*);
+    const CGameState& state() const;
     void game();
 };
+
+const int damageLanes = 8; // attacks next to each other in a batch add up in different copies of the losses
+
+// lanes[i % damageLanes * units + targets[i]] += damage[i], no two of damageLanes neighbouring attacks write
+// to the same place even if they share a target
+void scatterDamage(const int*, const int*, size_t, int*, size_t);
+void sumLanes(int*, size_t, int*); // loss[t] = the sum of the damageLanes copies of t, the lanes are zeroed
+
+class CBattle { // bots fight on a board of any size, every soldier steps towards the enemy leader on its own
+private:
+    CGameConfig config_;
+    CPlayingBoard board_;
+    CComposite attackingComposite_;
+    CComposite defendingComposite_;
+    bool finished_;
+    fraction winner_;
+    int rounds_;
+    bool batched_; // resolve a fraction's attacks at once, the outcome is the same as one by one
+    std::vector<std::pair<int, int> > attackers_; // the attack plan of the fraction, in the order of resolution
+    std::vector<std::pair<int, int> > targets_;
+    std::vector<CUnitData> roster_; // the living units of both fractions, the square is x * side + y
+    CTiledGrid<int> rosterAt_;      // the roster index of the unit on a square, -1 for an empty one
+    std::vector<int> damage_;       // the batch: per attack, the attacker's damage and the target's roster index
+    std::vector<int> targetSlots_;
+    std::vector<int> lanes_;        // damageLanes partial losses over the roster
+    std::vector<int> loss_;         // per roster index
+
+    CComposite& composite(fraction);
+    void placeArmy(fraction, uint64_t&);
+    void moveArmy(fraction);
+    void attackWithArmy(fraction);
+    void planAttacks(fraction);
+    void resolveSequentially(fraction);
+    void resolveBatched(fraction);
+    void kill(int, int, fraction);
+    void sweep(fraction, bool); // applies loss_ to the board if asked, removes the dead and compacts the roster
+    bool findTarget(int, int, std::pair<int, int>&) const;
+public:
+    CBattle(const CGameConfig&, uint64_t, bool = false);
+    ~CBattle() = default;
+
+    bool playRound(); // both move, then both attack, false once the battle is over
+    bool finished() const;
+    fraction winner() const;
+    int rounds() const;
+    const CPlayingBoard& board() const;
+    const CComposite& army(fraction) const;
+};
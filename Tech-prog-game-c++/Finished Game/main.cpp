@@ -1,7 +1,144 @@
 #include "classes.cpp"
+#include <cstring>
+#include <fstream>
 
-int main() {
-    CGame game = CGame();
-    game.game();
+// usage: Game [--ai attacking|defending|both] [--engine alphabeta|mcts] [--depth N] [--nodes N]
+//             [--iterations N] [--threads N] [--time MS] [--bench THREADS]
+//             [--config FILE] [--size N] [--attacking-units N] [--defending-units N]
+//             [--mode game|battle] [--combat batched]
+// --time gives the alpha-beta bots a budget per action, they deepen up to --depth (default 64 then)
+// --bench searches a fixed position suite with 1, 2, 4... threads and reports the speed of each setup
+// --config reads "size", "attacking_units" and "defending_units" lines, the options after it override the file
+// the game (composites, editing, human players, the search bots) is played on boards of 2 to 8 squares a side
+// --mode battle runs a different thing, a bot-only battle simulation on a CPlayingBoard of up to 4096 squares a side:
+// every soldier walks towards the enemy leader and hits the nearest enemy, there are no phases, squads or players
+// --combat batched resolves each side's attacks in the simulation at once instead of one by one
+
+void benchLazySmp(int depth, int maxThreads) {
+    std::vector<CGameState> suite = searchSuite(16, 2024);
+    double single = 0;
+    for (int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        double wall = 0;
+        std::vector<double> nodes(threads, 0), seconds(threads, 0);
+        for (size_t i = 0; i < suite.size(); ++i) {
+            CLazySmpPlayer player(depth, threads); // a fresh table for every position
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            player.chooseAction(suite[i]);
+            wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (int t = 0; t < threads; ++t) {
+                nodes[t] += player.nodes(t);
+                seconds[t] += player.seconds(t);
+            }
+        }
+        if (threads == 1) {
+            single = wall;
+        }
+        std::cout << threads << " threads: " << wall << " s, speedup " << single / wall << '\n';
+        for (int t = 0; t < threads; ++t) {
+            std::cout << "  thread " << t << ": " << (seconds[t] > 0 ? nodes[t] / seconds[t] : 0) << " nodes/s" << '\n';
+        }
+        if (threads == maxThreads) {
+            break;
+        }
+    }
 }
 
+int main(int argc, char** argv) {
+    bool bots[2] = {false, false};
+    bool mcts = false;
+    int depth = 0, time = 0, iterations = 2000, threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t nodes = 0;
+    int bench = 0;
+    bool batched = false;
+    bool battle = false;
+    CGameConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--ai") == 0) {
+            bots[attacking] = bots[attacking] || std::strcmp(argv[i + 1], "defending") != 0;
+            bots[defending] = bots[defending] || std::strcmp(argv[i + 1], "attacking") != 0;
+        } else if (std::strcmp(argv[i], "--engine") == 0) {
+            mcts = std::strcmp(argv[i + 1], "mcts") == 0;
+        } else if (std::strcmp(argv[i], "--depth") == 0) {
+            depth = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--nodes") == 0) {
+            nodes = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--iterations") == 0) {
+            iterations = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--time") == 0) {
+            time = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--bench") == 0) {
+            bench = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--mode") == 0) {
+            battle = std::strcmp(argv[i + 1], "battle") == 0;
+        } else if (std::strcmp(argv[i], "--combat") == 0) {
+            batched = std::strcmp(argv[i + 1], "batched") == 0;
+        } else if (std::strcmp(argv[i], "--config") == 0) {
+            std::ifstream file(argv[i + 1]);
+            if (!file || !readConfig(file, config)) {
+                std::cout << "Can not read the configuration from " << argv[i + 1] << "." << '\n';
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--size") == 0 || std::strcmp(argv[i], "--attacking-units") == 0 ||
+                   std::strcmp(argv[i], "--defending-units") == 0) {
+            std::string key = argv[i] + 2;
+            std::replace(key.begin(), key.end(), '-', '_');
+            if (!config.set(key, std::atoi(argv[i + 1]))) {
+                std::cout << "Wrong value of " << argv[i] << "." << '\n';
+                return 1;
+            }
+        }
+    }
+    if (!config.fits()) {
+        std::cout << "The armies do not fit on the board." << '\n';
+        return 1;
+    }
+    if (battle) {
+        CBattle simulation(config, std::chrono::steady_clock::now().time_since_epoch().count(), batched);
+        while (simulation.playRound() && simulation.rounds() < 100 * config.boardSide) {}
+        if (config.boardSide <= 64) {
+            simulation.board().printBoard();
+        }
+        if (!simulation.finished()) {
+            std::cout << "No winner after " << simulation.rounds() << " rounds." << '\n';
+            return 0;
+        }
+        std::cout << (simulation.winner() == attacking ? "Attacking " : "Defending ") << "team won in "
+                  << simulation.rounds() << " rounds!" << '\n';
+        return 0;
+    }
+    if (config.boardSide > boardSize) {
+        std::cout << "The game is played on boards of at most " << boardSize << " squares a side, "
+                  << "--mode battle runs the bot simulation on larger ones." << '\n';
+        return 1;
+    }
+    if (depth == 0) {
+        depth = (time > 0 ? 64 : 3);
+    }
+    if (bench > 0) {
+        benchLazySmp(depth, bench);
+        return 0;
+    }
+    CTranspositionTable table(1 << 20); // scores are kept for the attacking side, so both bots can share it
+    CAlphaBetaPlayer attackingSearch(depth, nodes, &table), defendingSearch(depth, nodes, &table);
+    attackingSearch.setTimeBudget(time);
+    defendingSearch.setTimeBudget(time);
+    CMctsPlayer attackingMcts(iterations, threads), defendingMcts(iterations, threads);
+    CGame game = CGame(CGameState(config));
+    if (bots[attacking]) {
+        game.setPlayer(attacking, mcts ? static_cast<CPlayer*>(&attackingMcts) : &attackingSearch);
+    }
+    if (bots[defending]) {
+        game.setPlayer(defending, mcts ? static_cast<CPlayer*>(&defendingMcts) : &defendingSearch);
+    }
+    game.game();
+    CAlphaBetaPlayer* searches[2] = {&defendingSearch, &attackingSearch};
+    for (int f = attacking; f >= defending && !mcts; --f) {
+        if (bots[f] && searches[f]->moves() > 0) {
+            std::cout << (f == attacking ? "Attacking" : "Defending") << " bot: " << searches[f]->moves()
+                      << " actions, " << 1000 * searches[f]->totalSeconds() / searches[f]->moves()
+                      << " ms on average, " << 1000 * searches[f]->longestSeconds() << " ms at most." << '\n';
+        }
+    }
+}
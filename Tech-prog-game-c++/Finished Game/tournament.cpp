@@ -0,0 +1,95 @@
+#include "classes.cpp"
+#include <cstring>
+
+// usage: Tournament [--games K] [--threads N] [--attacking random|greedy|search] [--defending random|greedy|search]
+//                   [--depth N] [--max-actions N] [--opening N] [--seed N]
+// every game has its own state, its first --opening actions are random so that deterministic agents differ
+// between games, a game still running after --max-actions is a draw
+
+enum gameOutcome {attackingWin, defendingWin, drawnGame};
+
+std::unique_ptr<CPlayer> makeAgent(const std::string& name, int depth, uint64_t seed) {
+    if (name == "random") {
+        return std::unique_ptr<CPlayer>(new CRandomPlayer(seed));
+    } else if (name == "greedy") {
+        return std::unique_ptr<CPlayer>(new CGreedyPlayer());
+    }
+    return std::unique_ptr<CPlayer>(new CAlphaBetaPlayer(depth));
+}
+
+gameOutcome playGame(const std::string& attackingAgent, const std::string& defendingAgent, int depth, int maxActions,
+                     int opening, uint64_t seed) {
+    CGameState state;
+    CRandomPlayer openingPlayer(splitMix64(seed));
+    std::unique_ptr<CPlayer> attackingPlayer = makeAgent(attackingAgent, depth, splitMix64(seed));
+    std::unique_ptr<CPlayer> defendingPlayer = makeAgent(defendingAgent, depth, splitMix64(seed));
+    playMatch(state, openingPlayer, openingPlayer, opening);
+    if (!playMatch(state, *attackingPlayer, *defendingPlayer, maxActions - opening)) {
+        return drawnGame;
+    }
+    return state.winner() == attacking ? attackingWin : defendingWin;
+}
+
+void printRate(const char* name, int count, int games) { // with a 95% Wilson score interval
+    const double z = 1.96;
+    double p = double(count) / games;
+    double center = (p + z * z / (2 * games)) / (1 + z * z / games);
+    double half = z * std::sqrt(p * (1 - p) / games + z * z / (4.0 * games * games)) / (1 + z * z / games);
+    std::cout << "  " << name << ": " << count << " (" << p << ", 95% CI " << std::max(0.0, center - half) << " - "
+              << std::min(1.0, center + half) << ")" << '\n';
+}
+
+int main(int argc, char** argv) {
+    int games = 100, threads = std::max(1u, std::thread::hardware_concurrency());
+    int depth = 2, maxActions = 400, opening = 4;
+    uint64_t seed = 1;
+    std::string agents[2] = {"greedy", "search"};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--games") == 0) {
+            games = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--attacking") == 0) {
+            agents[attacking] = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--defending") == 0) {
+            agents[defending] = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--depth") == 0) {
+            depth = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--max-actions") == 0) {
+            maxActions = std::max(1, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--opening") == 0) {
+            opening = std::max(0, std::atoi(argv[i + 1]));
+        } else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+    std::vector<gameOutcome> outcomes(games);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t stolen;
+    {
+        CWorkStealingPool pool(threads);
+        for (int game = 0; game < games; ++game) {
+            pool.submit([&, game]() {
+                outcomes[game] = playGame(agents[attacking], agents[defending], depth, maxActions,
+                                          std::min(opening, maxActions), seed + game);
+            });
+        }
+        pool.wait();
+        stolen = pool.stolen();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int count[3] = {0, 0, 0};
+    for (int game = 0; game < games; ++game) {
+        ++count[outcomes[game]];
+    }
+    std::cout << games << " games on " << threads << " threads in " << seconds << " s, " << stolen << " stolen."
+              << '\n';
+    std::cout << "Attacking fraction (" << agents[attacking] << "):" << '\n';
+    printRate("wins", count[attackingWin], games);
+    printRate("losses", count[defendingWin], games);
+    printRate("draws", count[drawnGame], games);
+    std::cout << "Defending fraction (" << agents[defending] << "):" << '\n';
+    printRate("wins", count[defendingWin], games);
+    printRate("losses", count[attackingWin], games);
+    printRate("draws", count[drawnGame], games);
+}
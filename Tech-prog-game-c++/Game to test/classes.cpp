@@ -3,11 +3,21 @@
 #include <cstdlib>
 #include <queue>
 #include <iostream>
+#include <sstream>
+#include <array>
 #include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <thread>
+#include <functional>
+#include <chrono>
 
 CUnit::CUnit(int health, int damage, fraction fraction, warriorType warriorType): health_(health),
              damage_(damage), fraction_(fraction), type_(warriorType) {}
 
+CUnit::CUnit(fraction fraction, warriorType warriorType): CUnit(unitStats[fraction][warriorType].health,
+             unitStats[fraction][warriorType].damage, fraction, warriorType) {}
+
 int CUnit::getHealth() const {
     return health_;
 }
@@ -55,11 +65,11 @@ bool betweenBorders(int cur_x, int cur_y, int new_x, int new_y, int leftBorder,
             abs(cur_y - new_y)) <= (int)rightBorder;
 }
 
-bool insideBattleField(int cur_x, int cur_y, std::shared_ptr<std::vector<std::vector<CUnit*> > > battleField) {
+bool insideBattleField(int cur_x, int cur_y, std::shared_ptr<const std::vector<std::vector<CUnit*> > > battleField) {
     return battleField != nullptr && cur_x >= 0 && cur_x < (int)battleField->size() && cur_y >= 0 && cur_y < (int)battleField->at(0).size();
 }
 
-CAttackingLeader::CAttackingLeader(): CUnit(6, 2, attacking, leader) {}
+CAttackingLeader::CAttackingLeader(): CUnit(attacking, leader) {}
 
 bool CAttackingLeader::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return betweenBorders(cur_x, cur_y, new_x, new_y, 1, 2);
@@ -69,7 +79,7 @@ bool CAttackingLeader::canAttack(int cur_x, int cur_y, int new_x, int new_y) con
     return betweenBorders(cur_x, cur_y, new_x, new_y, 1, 4);
 }
 
-CDefendingLeader::CDefendingLeader(): CUnit(1, 0, defending, leader) {}
+CDefendingLeader::CDefendingLeader(): CUnit(defending, leader) {}
 
 bool CDefendingLeader::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return abs(cur_x - new_x) + abs(cur_y - new_y) == 1;
@@ -79,7 +89,7 @@ bool CDefendingLeader::canAttack(int cur_x, int cur_y, int new_x, int new_y) con
     return false; // Defending leader can't attack!
 }
 
-CAttackingInfantry::CAttackingInfantry(): CUnit(2, 2, attacking, infantry) {}
+CAttackingInfantry::CAttackingInfantry(): CUnit(attacking, infantry) {}
 
 bool CAttackingInfantry::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return betweenBorders(cur_x, cur_y, new_x, new_y, 1, 2);
@@ -88,7 +98,7 @@ bool CAttackingInfantry::canAttack(int cur_x, int cur_y, int new_x, int new_y) c
     return abs(cur_x - new_x) + abs(cur_y - new_y) == 1;
 }
 
-CDefendingInfantry::CDefendingInfantry(): CUnit(1, 2, defending, infantry) {}
+CDefendingInfantry::CDefendingInfantry(): CUnit(defending, infantry) {}
 
 bool CDefendingInfantry::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return betweenBorders(cur_x, cur_y, new_x, new_y, 1, 2);
@@ -98,7 +108,7 @@ bool CDefendingInfantry::canAttack(int cur_x, int cur_y, int new_x, int new_y) c
     return abs(cur_x - new_x) + abs(cur_y - new_y) == 1;
 }
 
-CAttackingShooter::CAttackingShooter(): CUnit(1, 1, attacking, shooter) {}
+CAttackingShooter::CAttackingShooter(): CUnit(attacking, shooter) {}
 
 bool CAttackingShooter::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return abs(cur_x - new_x) + abs(cur_y - new_y) == 1;
@@ -108,7 +118,7 @@ bool CAttackingShooter::canAttack(int cur_x, int cur_y, int new_x, int new_y) co
     return betweenBorders(cur_x, cur_y, new_x, new_y, 1, 4);
 }
 
-CDefendingShooter::CDefendingShooter(): CUnit(1, 2, defending, shooter) {}
+CDefendingShooter::CDefendingShooter(): CUnit(defending, shooter) {}
 
 bool CDefendingShooter::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
     return abs(cur_x - new_x) + abs(cur_y - new_y) == 1;
@@ -142,543 +152,2901 @@ CUnit* CDefendingFactory::createShooter() const {
     return new CDefendingShooter;
 }
 
-std::shared_ptr<std::vector<std::vector<CUnit*> > > CPlayingBoard::desk_ = 0;
-
-std::shared_ptr<std::vector<std::vector<CUnit*> > > CPlayingBoard::board() {
-    if (desk_ == nullptr) {
-        desk_ = std::make_shared<std::vector<std::vector<CUnit*> > >(std::vector<std::vector<CUnit*> >(boardSize,
-                std::vector<CUnit*>(boardSize, nullptr)));
+const CUnit* unitPrototype(fraction fraction, warriorType type) {
+    static CDefendingFactory defendingFactory;
+    static CAttackingFactory attackingFactory;
+    static const std::unique_ptr<CUnit> prototypes[2][3] = {
+            {std::unique_ptr<CUnit>(defendingFactory.createLeader()),
+             std::unique_ptr<CUnit>(defendingFactory.createInfantry()),
+             std::unique_ptr<CUnit>(defendingFactory.createShooter())},
+            {std::unique_ptr<CUnit>(attackingFactory.createLeader()),
+             std::unique_ptr<CUnit>(attackingFactory.createInfantry()),
+             std::unique_ptr<CUnit>(attackingFactory.createShooter())}};
+    return prototypes[fraction][type].get();
+}
+
+constexpr int squareDistance(int from, int to) {
+    return (from / boardSize > to / boardSize ? from / boardSize - to / boardSize : to / boardSize - from / boardSize) +
+           (from % boardSize > to % boardSize ? from % boardSize - to % boardSize : to % boardSize - from % boardSize);
+}
+
+constexpr uint64_t reachMask(int from, CReach reach, int to = 0) {
+    return to == boardSize * boardSize ? 0 :
+           ((reach.minDistance <= squareDistance(from, to) && squareDistance(from, to) <= reach.maxDistance ?
+             uint64_t(1) << to : 0) | reachMask(from, reach, to + 1));
+}
+
+template <int... Squares>
+struct CSquareList {};
+
+template <int N, int... Squares>
+struct CMakeSquareList: CMakeSquareList<N - 1, N - 1, Squares...> {};
+
+template <int... Squares>
+struct CMakeSquareList<0, Squares...> {
+    typedef CSquareList<Squares...> type;
+};
+
+struct CReachTable {
+    uint64_t move[2][3][boardSize * boardSize];
+    uint64_t attack[2][3][boardSize * boardSize];
+};
+
+template <int... Squares>
+constexpr CReachTable makeReachTable(CSquareList<Squares...>) {
+    return CReachTable{{{{reachMask(Squares, unitStats[0][0].move)...},
+                         {reachMask(Squares, unitStats[0][1].move)...},
+                         {reachMask(Squares, unitStats[0][2].move)...}},
+                        {{reachMask(Squares, unitStats[1][0].move)...},
+                         {reachMask(Squares, unitStats[1][1].move)...},
+                         {reachMask(Squares, unitStats[1][2].move)...}}},
+                       {{{reachMask(Squares, unitStats[0][0].attack)...},
+                         {reachMask(Squares, unitStats[0][1].attack)...},
+                         {reachMask(Squares, unitStats[0][2].attack)...}},
+                        {{reachMask(Squares, unitStats[1][0].attack)...},
+                         {reachMask(Squares, unitStats[1][1].attack)...},
+                         {reachMask(Squares, unitStats[1][2].attack)...}}}};
+}
+
+// move and attack masks of every (fraction, warriorType, square), generated at compile time
+constexpr CReachTable reachTable = makeReachTable(CMakeSquareList<boardSize * boardSize>::type());
+
+static_assert(reachTable.move[attacking][leader][0] == ((uint64_t(1) << 1) | (uint64_t(1) << 2) |
+              (uint64_t(1) << boardSize) | (uint64_t(1) << (boardSize + 1)) | (uint64_t(1) << (2 * boardSize))),
+              "reach tables are generated wrong");
+
+struct CRingTable {
+    int size[2][3];
+    std::pair<int, int> offsets[2][3][ringSide * ringSide];
+    bool contains[2][3][ringSide][ringSide];
+
+    CRingTable();
+};
+
+CRingTable::CRingTable() { // Manhattan movement ring of every unit type, as offsets from the unit
+    for (int f = 0; f < 2; ++f) {
+        for (int t = 0; t < 3; ++t) {
+            size[f][t] = 0;
+            for (int xOffset = 1 - boardSize; xOffset < boardSize; ++xOffset) {
+                for (int yOffset = 1 - boardSize; yOffset < boardSize; ++yOffset) {
+                    int distance = std::abs(xOffset) + std::abs(yOffset);
+                    bool inRing = unitStats[f][t].move.minDistance <= distance &&
+                                  distance <= unitStats[f][t].move.maxDistance;
+                    contains[f][t][xOffset + boardSize - 1][yOffset + boardSize - 1] = inRing;
+                    if (inRing) {
+                        offsets[f][t][size[f][t]++] = std::make_pair(xOffset, yOffset);
+                    }
+                }
+            }
+        }
     }
-    return desk_;
 }
 
-CPlayingBoard::~CPlayingBoard() {
-    deleteBoard();
+const CRingTable& ringTable() {
+    static const CRingTable table;
+    return table;
 }
 
-bool CPlayingBoard::canMove(int cur_x, int cur_y, int new_x, int new_y) {
-    return insideBattleField(cur_x, cur_y, desk_) && insideBattleField(new_x, new_y, desk_) && desk_->at(cur_x)[cur_y] != nullptr &&
-    desk_->at(cur_x)[cur_y]->canMove(cur_x, cur_y, new_x, new_y) && desk_->at(new_x)[new_y] == nullptr && !(cur_x == new_x && cur_y == new_y);
-}
+struct CZobristTable {
+    uint64_t unit[2][3][healthBuckets][boardSize * boardSize];
+    uint64_t side[2];
+    uint64_t phase[finishedPhase + 1];
+    uint64_t attacker[boardSize * boardSize];
+    uint64_t moved[2][boardSize * boardSize]; // soldiers which have already moved on the iteration
 
-bool CPlayingBoard::canAttack(int cur_x, int cur_y, int new_x, int new_y) {
-    return insideBattleField(cur_x, cur_y, desk_) && insideBattleField(new_x, new_y, desk_) && desk_->at(cur_x)[cur_y] != nullptr  && desk_->at(new_x)[new_y] != nullptr  &&
-    desk_->at(cur_x)[cur_y]->canAttack(cur_x, cur_y, new_x, new_y) && desk_->at(cur_x)[cur_y]->getFraction() != desk_->at(new_x)[new_y]->getFraction()
-                             && !(cur_x == new_x && cur_y == new_y);
-}
+    CZobristTable();
+};
 
-bool CPlayingBoard::canPlaceUnit(int cur_x, int cur_y) {
-    return insideBattleField(cur_x, cur_y, desk_) && desk_->at(cur_x)[cur_y] == nullptr;
+uint64_t splitMix64(uint64_t& seed) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
-void CPlayingBoard::placeUnit(int cur_x, int cur_y, CUnit* unit) {
-    desk_->at(cur_x)[cur_y] = unit;
+CZobristTable::CZobristTable() { // fixed seed, so hashes are stable between runs
+    uint64_t seed = 0;
+    for (int f = 0; f < 2; ++f) {
+        for (int t = 0; t < 3; ++t) {
+            for (int h = 0; h < healthBuckets; ++h) {
+                for (int i = 0; i < boardSize * boardSize; ++i) {
+                    unit[f][t][h][i] = splitMix64(seed);
+                }
+            }
+        }
+        side[f] = splitMix64(seed);
+    }
+    for (int i = 0; i <= finishedPhase; ++i) {
+        phase[i] = splitMix64(seed);
+    }
+    for (int i = 0; i < boardSize * boardSize; ++i) {
+        attacker[i] = splitMix64(seed);
+    }
+    for (int f = 0; f < 2; ++f) {
+        for (int i = 0; i < boardSize * boardSize; ++i) {
+            moved[f][i] = splitMix64(seed);
+        }
+    }
 }
 
-void CPlayingBoard::attack(int cur_x, int cur_y, int new_x, int new_y) {
-    int damage = desk_->at(cur_x)[cur_y]->getDamage();
-    desk_->at(new_x)[new_y]->reduceHealth(damage);
+const CZobristTable& zobristTable() {
+    static const CZobristTable table;
+    return table;
 }
 
-void CPlayingBoard::deleteBoard() {
-    for (size_t i = 0; i < desk_->size(); ++i) {
-        for (size_t l = 0; l < desk_->at(i).size(); ++l) {
-            if (desk_->at(i)[l] != nullptr) {
-                delete desk_->at(i)[l];
-            }
+static_assert(boardSize * boardSize <= 64, "CBitBoard keeps a square or a unit id per bit of a 64-bit mask");
+static_assert(std::is_trivially_copyable<CBitBoard>::value, "boards are copied with the search and the snapshots");
+
+CBitBoard::CBitBoard(int side): side_(side) {
+    playable_ = 0;
+    for (int x = 0; x < side; ++x) {
+        for (int y = 0; y < side; ++y) {
+            playable_ |= squareMask(x, y);
         }
     }
-    desk_.reset();
+    clear();
 }
 
-CFactoryDecorator::CFactoryDecorator(CArmyFactory* factory): controlledFactory(factory) {}
+int CBitBoard::square(int x, int y) {
+    return x * boardSize + y;
+}
 
-CUnit* CFactoryDecorator::createLeader() const {
-    std::cout << "New leader created!" << '\n';
-    return controlledFactory->createLeader();
+uint64_t CBitBoard::squareMask(int x, int y) {
+    return uint64_t(1) << square(x, y);
 }
 
-CUnit* CFactoryDecorator::createInfantry() const {
-    std::cout << "New infantry created!" << '\n';
-    return controlledFactory->createInfantry();
+constexpr uint64_t firstColumn(int x = 0) {
+    return x == boardSize ? 0 : (uint64_t(1) << (x * boardSize)) | firstColumn(x + 1);
 }
 
-CUnit* CFactoryDecorator::createShooter() const {
-    std::cout << "New shooter created!" << '\n';
-    return controlledFactory->createShooter();
+uint64_t CBitBoard::shiftMask(uint64_t mask, int xOffset, int yOffset) {
+    if (xOffset <= -boardSize || xOffset >= boardSize || yOffset <= -boardSize || yOffset >= boardSize) {
+        return 0;
+    }
+    uint64_t lowColumns = firstColumn() * ((uint64_t(1) << (boardSize - std::abs(yOffset))) - 1);
+    mask &= (yOffset >= 0 ? lowColumns : lowColumns << -yOffset); // the columns which stay on the grid
+    int offset = xOffset * boardSize + yOffset;
+    mask = (offset >= 0 ? mask << offset : mask >> -offset);
+    return boardSize * boardSize == 64 ? mask : mask & ((uint64_t(1) << (boardSize * boardSize)) - 1);
 }
 
-CNode::CNode(int x, int y, int depth): depth_(depth), moveOnTheIteration(false) {
-    savedComponent_ = std::make_pair(x, y);
-    children_ = (std::vector<std::shared_ptr<CNode> >());
+bool CBitBoard::inside(int x, int y) {
+    return x >= 0 && x < boardSize && y >= 0 && y < boardSize;
 }
 
-bool operator <(const std::shared_ptr<CNode>& a, const std::shared_ptr<CNode>& b) {
-    std::pair<int, int> pair1 = a->getSavedComponent();
-    std::pair<int, int> pair2 = b->getSavedComponent();
-    return (pair1 < pair2);
+bool CBitBoard::onBoard(int x, int y) const {
+    return x >= 0 && x < side_ && y >= 0 && y < side_;
 }
 
-bool CComparator::operator ()(const std::shared_ptr<CNode>& a, const std::shared_ptr<CNode>& b) {
-    return a < b;
+int CBitBoard::side() const {
+    return side_;
 }
 
-std::pair<int, int> CNode::getSavedComponent() const {
-    return savedComponent_;
+uint64_t CBitBoard::playable() const {
+    return playable_;
 }
 
-bool CNode::addChild(int x, int y) {
-    if (x == -1 && depth_ >= maxCompositeDepth - 1) {
-        return false;
-    }
-    if (x != -1 && depth_ != maxCompositeDepth - 1) {
-        return false;
-    }
-    CNode childNode = CNode(x, y, depth_ + 1);
-    std::shared_ptr<CNode> childNodePtr = std::make_shared<CNode>(childNode);
-    children_.push_back(childNodePtr);
-    return true;
+void CBitBoard::clear() {
+    fractionMask_[defending] = fractionMask_[attacking] = 0;
+    typeMask_[leader] = typeMask_[infantry] = typeMask_[shooter] = 0;
+    std::fill(unitAt_, unitAt_ + boardSize * boardSize, -1);
+    aliveUnits_ = 0;
+    attackers_[defending] = attackers_[attacking] = 0;
+    targets_[defending] = targets_[attacking] = 0;
+    std::fill(threats_[defending], threats_[defending] + boardSize * boardSize, 0);
+    std::fill(threats_[attacking], threats_[attacking] + boardSize * boardSize, 0);
+    threatMap_[defending] = threatMap_[attacking] = 0;
+    hash_ = 0;
 }
 
-bool CNode::removeChild(int x, int y) {
-    size_t idx = 0;
-    for (idx = 0; idx < children_.size(); ++idx) {
-        if (children_[idx]->savedComponent_ == std::make_pair(x, y)) {
-            break;
+void CBitBoard::addThreats(const CUnitData& unit, int delta) {
+    for (uint64_t rest = reachTable.attack[unit.fraction][unit.type][unit.square]; rest != 0; rest &= rest - 1) {
+        int cur = __builtin_ctzll(rest);
+        threats_[unit.fraction][cur] += delta;
+        if (threats_[unit.fraction][cur] != 0) {
+            threatMap_[unit.fraction] |= uint64_t(1) << cur;
+        } else {
+            threatMap_[unit.fraction] &= ~(uint64_t(1) << cur);
         }
     }
-    if (idx == children_.size() || !children_[idx]->children_.empty()) {
-        return false;
-    }
-    children_.erase(children_.begin() + idx);
-    return true;
 }
 
-std::shared_ptr<CNode> CNode::getNode(int x, int y) const {
-    if (savedComponent_.first != -1) {
-        return nullptr;
-    }
-    for (size_t i = 0; i < children_.size(); ++i) {
-        if (children_[i]->savedComponent_ == std::make_pair(x, y)) {
-            return children_[i];
-        }
-        std::shared_ptr<CNode> possibleAns = children_[i]->getNode(x, y);
-        if (possibleAns != nullptr) {
-            return possibleAns;
-        }
+uint64_t CBitBoard::unitKey(int id) const {
+    const CUnitData& unit = units_[id];
+    int bucket = std::min(std::max(int(unit.health), 0), healthBuckets - 1);
+    return zobristTable().unit[unit.fraction][unit.type][bucket][unit.square];
+}
+
+uint64_t CBitBoard::hash() const {
+    return hash_;
+}
+
+uint64_t CBitBoard::computeHash() const {
+    uint64_t hash = 0;
+    for (uint64_t rest = aliveUnits_; rest != 0; rest &= rest - 1) {
+        hash ^= unitKey(__builtin_ctzll(rest));
     }
-    return nullptr;
+    return hash;
 }
 
-std::shared_ptr<CNode> CNode::getParentNode(int x, int y, std::shared_ptr<CNode> prevCNode = nullptr) const {
-    if (savedComponent_.first != -1) {
-        return nullptr;
+void CBitBoard::refreshUnit(int cur) {
+    int x = cur / boardSize, y = cur % boardSize;
+    fraction fraction = getFraction(x, y);
+    int enemy = 1 - fraction;
+    uint64_t mask = uint64_t(1) << cur;
+    if (reachTable.attack[fraction][getWarriorType(x, y)][cur] & fractionMask_[enemy]) {
+        attackers_[fraction] |= mask;
+    } else {
+        attackers_[fraction] &= ~mask;
     }
-    for (size_t i = 0; i < children_.size(); ++i) {
-        if (children_[i]->savedComponent_ == std::make_pair(x, y)) {
-            return prevCNode;
-        }
-        std::shared_ptr<CNode> possibleAns = children_[i]->getParentNode(x, y, children_[i]);
-        if (possibleAns != nullptr) {
-            return possibleAns;
-        }
+    if (threatMap_[enemy] & mask) {
+        targets_[enemy] |= mask;
+    } else {
+        targets_[enemy] &= ~mask;
     }
-    return nullptr;
 }
 
-CComposite::CComposite(fraction fraction): fraction_(fraction) {
-    topNode_ = std::make_shared<CNode>(CNode(-1, 1, 1));
-    usedNumbers_.insert(1);
-    std::shared_ptr<CNode> ptr = topNode_;
-    int i = 2;
-    while (i != maxCompositeDepth) {
-        usedNumbers_.insert(i);
-        ptr->addChild(-1, i);
-        ptr = ptr->children_[0];
-        i++;
-    }
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
-    for (int i = 0; i < boardSize; ++i) {
-        for (int j = 0; j < boardSize; ++j) {
-            if (board->at(i)[j] != nullptr && board->at(i)[j]->getFraction() == fraction_) {
-                ptr->addChild(i, j);
+void CBitBoard::refreshAround(uint64_t changed) {
+    uint64_t affected = changed;
+    for (uint64_t rest = changed; rest != 0; rest &= rest - 1) {
+        int cur = __builtin_ctzll(rest);
+        for (int f = 0; f < 2; ++f) {
+            for (int t = 0; t < 3; ++t) {
+                affected |= reachTable.attack[f][t][cur];
             }
         }
     }
+    for (int f = 0; f < 2; ++f) {
+        attackers_[f] &= fractionMask_[f];
+        targets_[f] &= fractionMask_[1 - f];
+    }
+    for (uint64_t rest = affected & occupied(); rest != 0; rest &= rest - 1) {
+        refreshUnit(__builtin_ctzll(rest));
+    }
 }
 
-std::shared_ptr<CNode> CComposite::getNode(int x, int y) const {
-    if (x == -1 && y == 1) {
-        return topNode_;
-    }
-    return topNode_->getNode(x, y);
+uint64_t CBitBoard::occupied() const {
+    return fractionMask_[defending] | fractionMask_[attacking];
 }
 
-void CComposite::printComposite() const {
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(topNode_);
-    while (!q.empty()) {
-        std::shared_ptr<CNode> ptr = q.front();
-        q.pop();
-        if (ptr->savedComponent_.first == -1) {
-            std::cout << "Structure № " << ptr->savedComponent_.second << " " << structureNames[ptr->depth_ - 1] << "."
-                      << '\n';
-            std::cout << "Children: ";
-            std::sort(ptr->children_.begin(), ptr->children_.end(), CComparator());
-            for (size_t i = 0; i < ptr->children_.size(); ++i) {
-                q.push(ptr->children_[i]);
-                std::cout << structureNames[ptr->children_[i]->depth_ - 1] << " ";
-                if (ptr->children_[i]->savedComponent_.first != -1) {
-                    std::cout << ptr->children_[i]->savedComponent_.first << ", ";
-                }
-                std::cout << ptr->children_[i]->savedComponent_.second << "; ";
-            }
-            std::cout << '\n';
-        }
-    }
+uint64_t CBitBoard::fractionMask(fraction fraction) const {
+    return fractionMask_[fraction];
 }
 
-bool CComposite::addChild(int x) {
-    std::shared_ptr<CNode> ptr = getNode(-1, x);
-    int num = 1;
-    while (usedNumbers_.count(num) > 0) {
-        num++;
+uint64_t CBitBoard::typeMask(warriorType type) const {
+    return typeMask_[type];
+}
+
+bool CBitBoard::isOccupied(int x, int y) const {
+    return inside(x, y) && (occupied() & squareMask(x, y)) != 0;
+}
+
+fraction CBitBoard::getFraction(int x, int y) const {
+    return (fractionMask_[attacking] & squareMask(x, y)) != 0 ? attacking : defending;
+}
+
+warriorType CBitBoard::getWarriorType(int x, int y) const {
+    uint64_t mask = squareMask(x, y);
+    if (typeMask_[leader] & mask) {
+        return leader;
     }
-    usedNumbers_.insert(num);
-    return ptr->addChild(-1, num);
+    return (typeMask_[infantry] & mask) != 0 ? infantry : shooter;
 }
 
-std::shared_ptr<CNode> CComposite::getParentNode(int x, int y) const {
-    if (topNode_->savedComponent_.first == x && topNode_->savedComponent_.second == y) {
-        return nullptr;
+int CBitBoard::getHealth(int x, int y) const {
+    int id = unitAt_[square(x, y)];
+    return id == -1 ? 0 : units_[id].health;
+}
+
+int CBitBoard::unitAt(int x, int y) const {
+    return unitAt_[square(x, y)];
+}
+
+const CUnitData& CBitBoard::unit(int id) const {
+    return units_[id];
+}
+
+uint64_t CBitBoard::aliveUnits() const {
+    return aliveUnits_;
+}
+
+bool CBitBoard::canPlaceUnit(int cur_x, int cur_y) const {
+    return onBoard(cur_x, cur_y) && (occupied() & squareMask(cur_x, cur_y)) == 0;
+}
+
+bool CBitBoard::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
+    if (!isOccupied(cur_x, cur_y) || !onBoard(new_x, new_y)) {
+        return false;
     }
-    return topNode_->getParentNode(x, y, topNode_);
+    uint64_t reach = reachTable.move[getFraction(cur_x, cur_y)][getWarriorType(cur_x, cur_y)][square(cur_x, cur_y)];
+    return (reach & ~occupied() & squareMask(new_x, new_y)) != 0;
 }
 
-bool CComposite::removeChild(int x, int y) {
-    std::shared_ptr<CNode> ptr = getParentNode(x, y);
-    if (ptr == nullptr) {
+bool CBitBoard::canAttack(int cur_x, int cur_y, int new_x, int new_y) const {
+    if (!isOccupied(cur_x, cur_y) || !inside(new_x, new_y)) {
         return false;
     }
-    if(ptr->removeChild(x, y)) {
-        if(x == -1) {
-            usedNumbers_.erase(y);
-        }
-        return true;
+    fraction fraction = getFraction(cur_x, cur_y);
+    uint64_t reach = reachTable.attack[fraction][getWarriorType(cur_x, cur_y)][square(cur_x, cur_y)];
+    return (reach & fractionMask_[1 - fraction] & squareMask(new_x, new_y)) != 0;
+}
+
+bool CBitBoard::canAttack(int x, int y) const {
+    return inside(x, y) && ((attackers_[defending] | attackers_[attacking]) & squareMask(x, y)) != 0;
+}
+
+uint64_t CBitBoard::attackers(fraction fraction) const {
+    return attackers_[fraction];
+}
+
+uint64_t CBitBoard::targets(fraction fraction) const {
+    return targets_[fraction];
+}
+
+int CBitBoard::threatCount(fraction fraction, int x, int y) const {
+    return inside(x, y) ? threats_[fraction][square(x, y)] : 0;
+}
+
+uint64_t CBitBoard::threatMap(fraction fraction) const {
+    return threatMap_[fraction];
+}
+
+bool CBitBoard::leaderInDanger() const {
+    return (threatMap_[attacking] & fractionMask_[defending] & typeMask_[leader]) != 0;
+}
+
+uint64_t CBitBoard::targetsOf(int x, int y) const {
+    if (!isOccupied(x, y)) {
+        return 0;
     }
-    return false;
+    fraction fraction = getFraction(x, y);
+    return reachTable.attack[fraction][getWarriorType(x, y)][square(x, y)] & fractionMask_[1 - fraction];
 }
 
-bool CComposite::switchChild (int x, int y, int comp_num) {
-    if (getParentNode(x, y) == nullptr || x == -1) {
-        return false;
+uint64_t CBitBoard::nodeMask(const CComposite& composite, int node) {
+    uint64_t mask = 0;
+    for (int cur = node; cur != -1; cur = composite.nextInSubtree(node, cur)) {
+        std::pair<int, int> component = composite.node(cur).getSavedComponent();
+        if (component.first != -1 && inside(component.first, component.second)) {
+            mask |= squareMask(component.first, component.second);
+        }
     }
-    removeChild(x, y);
-    std::shared_ptr<CNode> futureComponent = getNode(-1, comp_num);
-    if (futureComponent->depth_ != maxCompositeDepth - 1) {
+    return mask;
+}
+
+bool CBitBoard::canMoveComposite(const CComposite& composite, std::pair<int, int> nodePair, int xOffset,
+                                 int yOffset) const {
+    int ptr = composite.getNode(nodePair.first, nodePair.second);
+    if (ptr == -1) {
         return false;
     }
-    futureComponent->addChild(x, y);
-    return true;
+    return canMoveSquad(nodeMask(composite, ptr), xOffset, yOffset);
 }
 
-bool CPlayingBoard::canMoveComposite(const CComposite& composite, std::pair<int, int> nodePair, int xOffset, int yOffset) {
-    std::shared_ptr<CNode> ptr = composite.getNode(nodePair.first, nodePair.second);
-    if (ptr == nullptr) {
+bool CBitBoard::canMoveSquad(uint64_t squad, int xOffset, int yOffset) const {
+    if ((squad & ~occupied()) != 0) {
         return false;
     }
-    std::set<std::pair<int, int> > pairsInNode;
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(ptr);
-    while (!q.empty()) {
-        std::shared_ptr<CNode> curPtr = q.front();
-        q.pop();
-        if (curPtr->getSavedComponent().first != -1) {
-            pairsInNode.insert(curPtr->getSavedComponent());
-        } else {
-            for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                q.push(curPtr->children_[i]);
-            }
-        }
+    if (squad == 0) {
+        return true;
     }
-    bool canMove = true;
-    for (auto elem: pairsInNode) {
-        int cur_x = elem.first, cur_y = elem.second;
-        int new_x = elem.first + xOffset, new_y = elem.second + yOffset;
-        canMove = canMove && insideBattleField(cur_x, cur_y, desk_) && insideBattleField(new_x, new_y, desk_) &&
-                desk_->at(cur_x)[cur_y] != nullptr && desk_->at(cur_x)[cur_y]->canMove(cur_x, cur_y, new_x, new_y) &&
-                (desk_->at(new_x)[new_y] == nullptr || pairsInNode.count(std::make_pair(new_x, new_y)) > 0)
-                && !(cur_x == new_x && cur_y == new_y);
+    if (xOffset <= -boardSize || xOffset >= boardSize || yOffset <= -boardSize || yOffset >= boardSize) {
+        return false;
     }
-    return canMove;
-}
-
-void CPlayingBoard::moveComposite(int x, int y, int xOffset, int yOffset, CComposite composite) {
-    if (canMoveComposite(composite, std::make_pair(x, y), xOffset, yOffset)) {
-        std::pair<int, int> nodePair = std::make_pair(x, y);
-        std::shared_ptr<CNode> ptr = composite.getNode(nodePair.first, nodePair.second);
-        if (ptr == nullptr) {
-            return;
-        }
-        std::queue<std::shared_ptr<CNode> > q;
-        q.push(ptr);
-        std::vector<std::pair<std::pair<int, int>, CUnit*> > unitPosition;
-        std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
-        while (!q.empty()) {
-            std::shared_ptr<CNode> curPtr = q.front();
-            if (curPtr->getSavedComponent().first != -1) {
-                curPtr->moveOnTheIteration = true;
-            }
-            q.pop();
-            if (curPtr->getSavedComponent().first != -1) {
-                std::pair<int, int> curPair = curPtr->getSavedComponent();
-                curPtr->savedComponent_ = std::make_pair(curPair.first + xOffset, curPair.second + yOffset);
-                unitPosition.emplace_back(std::make_pair(curPtr->getSavedComponent(), board->at(curPair.first)[curPair.second]));
-                board->at(curPair.first)[curPair.second] = nullptr;
-            } else {
-                for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                    q.push(curPtr->children_[i]);
-                }
+    const CRingTable& rings = ringTable();
+    for (int f = 0; f < 2; ++f) { // the offset must be in the ring of every type in the squad
+        for (int t = 0; t < 3; ++t) {
+            if ((squad & fractionMask_[f] & typeMask_[t]) != 0 &&
+                !rings.contains[f][t][xOffset + boardSize - 1][yOffset + boardSize - 1]) {
+                return false;
             }
         }
-        for (size_t i = 0; i < unitPosition.size(); ++i) {
-            std::pair<int, int> curPair = unitPosition[i].first;
-            board->at(curPair.first)[curPair.second] = unitPosition[i].second;
-        }
     }
+    return squadFits(squad, xOffset, yOffset);
 }
 
-std::shared_ptr<CNode> CComposite::getTopNode() const {
-    return topNode_;
+bool CBitBoard::squadFits(uint64_t squad, int xOffset, int yOffset) const {
+    uint64_t target = shiftMask(squad, xOffset, yOffset) & playable_;
+    return __builtin_popcountll(target) == __builtin_popcountll(squad) && (target & occupied() & ~squad) == 0;
 }
 
-bool CPlayingBoard::allMovedComposite(std::shared_ptr<CNode> topNode, int i) {
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(topNode);
-    std::vector<std::pair<int, int> > unmovedUnits;
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
-    while (!q.empty()) {
-        std::shared_ptr<CNode> curPtr = q.front();
-        q.pop();
-        if (curPtr->getSavedComponent().first != -1) {
-            if (!curPtr->moveOnTheIteration) {
-                unmovedUnits.push_back(curPtr->getSavedComponent());
-            }
-        } else {
-            for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                q.push(curPtr->children_[i]);
-            }
+size_t CBitBoard::generateMoves(const CComposite& composite, CAction* buffer, size_t capacity) const {
+    size_t count = 0;
+    bool moved = false;
+    generateNodeMoves(composite, composite.getTopNode(), moved, buffer, capacity, count);
+    return count; // may exceed capacity, then only the first capacity moves were written
+}
+
+uint64_t CBitBoard::generateNodeMoves(const CComposite& composite, int node, bool& moved, CAction* buffer,
+                                      size_t capacity, size_t& count) const {
+    uint64_t squad = 0;
+    moved = false;
+    const CNode& ptr = composite.node(node);
+    if (ptr.getSavedComponent().first != -1) {
+        moved = composite.isMoved(node);
+        squad = nodeMask(composite, node);
+    } else {
+        for (int child = ptr.getFirstChild(); child != -1; child = composite.node(child).getNextSibling()) {
+            bool childMoved = false;
+            squad |= generateNodeMoves(composite, child, childMoved, buffer, capacity, count);
+            moved = moved || childMoved;
         }
     }
-    if (unmovedUnits.empty()) {
-        return true;
-    }
-    if (i > 0) {
-        std::cout << "This composite's components were unmoved on the iteration:" << '\n';
-        for (size_t i = 0; i < unmovedUnits.size(); ++i) {
-            std::cout << unmovedUnits[i].first << " " << unmovedUnits[i].second << '\n';
-        }
+    if (!moved && squad != 0) {
+        addSquadMoves(ptr.getSavedComponent(), squad, buffer, capacity, count);
     }
-    return false;
+    return squad;
 }
 
-bool CPlayingBoard::allUnmovedComposite(std::shared_ptr<CNode> topNode) {
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(topNode);std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
-    while (!q.empty()) {
-        std::shared_ptr<CNode> curPtr = q.front();
-        q.pop();
-        if (curPtr->getSavedComponent().first != -1) {
-            if (curPtr->moveOnTheIteration) {
-                return false;
+void CBitBoard::addSquadMoves(std::pair<int, int> nodePair, uint64_t squad, CAction* buffer, size_t capacity,
+                              size_t& count) const {
+    if ((squad & ~occupied()) != 0) {
+        return;
+    }
+    const CRingTable& rings = ringTable();
+    bool present[2][3];
+    int driverFraction = -1, driverType = -1; // the type with the smallest ring drives the enumeration
+    for (int f = 0; f < 2; ++f) {
+        for (int t = 0; t < 3; ++t) {
+            present[f][t] = (squad & fractionMask_[f] & typeMask_[t]) != 0;
+            if (present[f][t] && (driverFraction == -1 || rings.size[f][t] < rings.size[driverFraction][driverType])) {
+                driverFraction = f;
+                driverType = t;
             }
-        } else {
-            for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                q.push(curPtr->children_[i]);
+        }
+    }
+    for (int i = 0; i < rings.size[driverFraction][driverType]; ++i) {
+        int xOffset = rings.offsets[driverFraction][driverType][i].first;
+        int yOffset = rings.offsets[driverFraction][driverType][i].second;
+        bool fits = true;
+        for (int f = 0; f < 2 && fits; ++f) {
+            for (int t = 0; t < 3 && fits; ++t) {
+                fits = !present[f][t] || rings.contains[f][t][xOffset + boardSize - 1][yOffset + boardSize - 1];
+            }
+        }
+        if (fits && squadFits(squad, xOffset, yOffset)) {
+            if (count < capacity) {
+                buffer[count] = CAction(moveAction, nodePair.first, nodePair.second, xOffset, yOffset);
             }
+            ++count;
         }
     }
-    return true;
 }
 
-void CComposite::startNewMove() {
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(getTopNode());
-    while (!q.empty()) {
-        std::shared_ptr<CNode> curPtr = q.front();
-        q.pop();
-        if (curPtr->getSavedComponent().first != -1) {
-            curPtr->moveOnTheIteration = false;
-        } else {
-            for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                q.push(curPtr->children_[i]);
-            }
-        }
+void CBitBoard::placeUnit(int x, int y, fraction fraction, warriorType type, int health) {
+    CUnitData unit;
+    unit.fraction = fraction;
+    unit.type = type;
+    unit.health = health;
+    unit.square = square(x, y);
+    restoreUnit(__builtin_ctzll(~aliveUnits_), unit); // a board never holds more units than squares
+}
+
+void CBitBoard::restoreUnit(int id, const CUnitData& unit) {
+    uint64_t mask = uint64_t(1) << unit.square;
+    aliveUnits_ |= uint64_t(1) << id;
+    units_[id] = unit;
+    unitAt_[unit.square] = id;
+    hash_ ^= unitKey(id);
+    fractionMask_[unit.fraction] |= mask;
+    typeMask_[unit.type] |= mask;
+    addThreats(unit, 1);
+    refreshAround(mask);
+}
+
+void CBitBoard::removeUnit(int x, int y) {
+    uint64_t mask = ~squareMask(x, y);
+    fractionMask_[defending] &= mask;
+    fractionMask_[attacking] &= mask;
+    typeMask_[leader] &= mask;
+    typeMask_[infantry] &= mask;
+    typeMask_[shooter] &= mask;
+    int id = unitAt_[square(x, y)];
+    if (id != -1) {
+        hash_ ^= unitKey(id);
+        addThreats(units_[id], -1);
+        aliveUnits_ &= ~(uint64_t(1) << id);
+        unitAt_[square(x, y)] = -1;
     }
+    refreshAround(~mask);
 }
 
-void CVisitor::visit(CDefendingInfantry) const {
-    std::cout << "1";
+void CBitBoard::reduceHealth(int x, int y, int loss) {
+    int id = unitAt_[square(x, y)];
+    if (id == -1) { // an empty square has no health to lose
+        return;
+    }
+    hash_ ^= unitKey(id);
+    units_[id].health -= loss;
+    hash_ ^= unitKey(id);
 }
 
-void CVisitor::visit(CDefendingShooter) const {
-    std::cout << "2";
+void CBitBoard::attack(int cur_x, int cur_y, int new_x, int new_y) {
+    int id = unitAt_[square(cur_x, cur_y)];
+    if (id == -1) {
+        return;
+    }
+    reduceHealth(new_x, new_y, unitStats[units_[id].fraction][units_[id].type].damage);
 }
 
-void CVisitor::visit(CDefendingLeader) const {
-    std::cout << "3";
+void CBitBoard::moveComposite(CComposite& composite, std::pair<int, int> nodePair, int xOffset, int yOffset) {
+    int ptr = composite.getNode(nodePair.first, nodePair.second);
+    if (ptr == -1) {
+        return;
+    }
+    uint64_t squad = nodeMask(composite, ptr);
+    if (canMoveSquad(squad, xOffset, yOffset)) {
+        moveSquad(composite, ptr, squad, xOffset, yOffset);
+    }
 }
 
-void CVisitor::visit(CAttackingInfantry) const {
-    std::cout << "7";
+void CBitBoard::moveSquad(CComposite& composite, int ptr, uint64_t squad, int xOffset, int yOffset) {
+    int offset = xOffset * boardSize + yOffset;
+    uint64_t movedFraction[2], movedType[3];
+    for (int f = 0; f < 2; ++f) {
+        movedFraction[f] = shiftMask(fractionMask_[f] & squad, xOffset, yOffset);
+    }
+    for (int t = 0; t < 3; ++t) {
+        movedType[t] = shiftMask(typeMask_[t] & squad, xOffset, yOffset);
+    }
+    int8_t movedUnit[boardSize * boardSize];
+    for (uint64_t rest = squad; rest != 0; rest &= rest - 1) { // unit ids and hash keys still go one by one
+        int cur = __builtin_ctzll(rest);
+        movedUnit[cur + offset] = unitAt_[cur];
+        hash_ ^= unitKey(unitAt_[cur]);
+        addThreats(units_[unitAt_[cur]], -1);
+        unitAt_[cur] = -1;
+    }
+    for (int f = 0; f < 2; ++f) {
+        fractionMask_[f] = (fractionMask_[f] & ~squad) | movedFraction[f];
+    }
+    for (int t = 0; t < 3; ++t) {
+        typeMask_[t] = (typeMask_[t] & ~squad) | movedType[t];
+    }
+    for (uint64_t rest = squad; rest != 0; rest &= rest - 1) {
+        int target = __builtin_ctzll(rest) + offset;
+        unitAt_[target] = movedUnit[target];
+        units_[movedUnit[target]].square = target;
+        hash_ ^= unitKey(movedUnit[target]);
+        addThreats(units_[movedUnit[target]], 1);
+    }
+    refreshAround(squad | movedFraction[defending] | movedFraction[attacking]);
+    composite.moveNode(ptr, xOffset, yOffset);
 }
 
-void CVisitor::visit(CAttackingShooter) const {
-    std::cout << "8";
+template <typename T>
+CTiledGrid<T>::CTiledGrid(int side, const T& empty): side_(side), tilesPerRow_((side + tileSide - 1) / tileSide),
+        empty_(empty) {
+    tiles_.resize(size_t(tilesPerRow_) * tilesPerRow_);
 }
 
-void CVisitor::visit(CAttackingLeader) const {
-    std::cout << "9";
+template <typename T>
+size_t CTiledGrid<T>::tile(int x, int y) const {
+    return size_t(x / tileSide) * tilesPerRow_ + y / tileSide;
 }
 
-void CAttackingLeader::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+int CTiledGrid<T>::cell(int x, int y) {
+    return (x % tileSide) * tileSide + y % tileSide;
 }
 
-void CAttackingInfantry::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+int CTiledGrid<T>::side() const {
+    return side_;
 }
 
-void CAttackingShooter::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+const T& CTiledGrid<T>::get(int x, int y) const {
+    const std::vector<T>& cells = tiles_[tile(x, y)];
+    return cells.empty() ? empty_ : cells[cell(x, y)];
 }
 
-void CDefendingLeader::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+T& CTiledGrid<T>::at(int x, int y) {
+    std::vector<T>& cells = tiles_[tile(x, y)];
+    if (cells.empty()) {
+        cells.assign(tileSide * tileSide, empty_);
+    }
+    return cells[cell(x, y)];
 }
 
-void CDefendingInfantry::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+void CTiledGrid<T>::set(int x, int y, const T& value) {
+    if (!(value == empty_) || !tiles_[tile(x, y)].empty()) {
+        at(x, y) = value;
+    }
 }
 
-void CDefendingShooter::visit(CVisitor visitor) const {
-    visitor.visit(*this);
+template <typename T>
+size_t CTiledGrid<T>::allocatedTiles() const {
+    size_t count = 0;
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+        count += !tiles_[i].empty();
+    }
+    return count;
 }
 
-void CPlayingBoard::printBoard() {
-    std::cout << "Current board:" << '\n';
-    CVisitor visitor = CVisitor();
-    for (size_t i = 0; i < desk_->size(); ++i) {
-        for (size_t l = 0; l < desk_->at(i).size(); ++l) {
-            if (desk_->at(i)[l] == nullptr) {
-                std::cout << "x";
-            } else {
-                desk_->at(i)[l]->visit(visitor);
+template <typename T>
+template <typename Visitor>
+void CTiledGrid<T>::forEach(Visitor visitor) const {
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+        for (size_t j = 0; j < tiles_[i].size(); ++j) {
+            if (!(tiles_[i][j] == empty_)) {
+                visitor(int(i / tilesPerRow_) * tileSide + int(j) / tileSide,
+                        int(i % tilesPerRow_) * tileSide + int(j) % tileSide, tiles_[i][j]);
             }
-            std::cout << " ";
         }
-        std::cout << '\n';
     }
-    std::cout << '\n' << "x - empty" << '\n';
-    std::cout << "1 - defending infantry" << '\n';
-    std::cout << "2 - defending shooter" << '\n';
-    std::cout << "3 - defending leader" << '\n';
-    std::cout << "7 - attacking infantry" << '\n';
-    std::cout << "8 - attacking shooter" << '\n';
-    std::cout << "9 - attacking leader" << '\n' << '\n';
 }
 
-CGame::CGame(): gameFinished(false), winner(attacking), attackingComposite(attacking), defendingComposite(defending) {
-    attackingFactory = new CAttackingFactory();
-    defendingFactory = new CDefendingFactory();
-    CPlayingBoard::board(); // to generate the board;
-    std::cout << "Welcome to the game." << '\n' << '\n';
-    CPlayingBoard::printBoard();
-    placeArmy();
-    attackingComposite = CComposite(attacking); // to make composites correct
-    defendingComposite = CComposite(defending); // to make composites correct
+template <typename T>
+void CTiledGrid<T>::clear() {
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+        std::vector<T>().swap(tiles_[i]);
+    }
 }
 
-
-CGame::~CGame() {
-    CPlayingBoard::deleteBoard();
-    delete attackingFactory;
-    delete defendingFactory;
+CSpatialIndex::CSpatialIndex(int side): entryAt_(side, -1), size_(0) {
+    heads_[defending] = CTiledGrid<int>((side + bucketSide - 1) / bucketSide, -1);
+    heads_[attacking] = CTiledGrid<int>((side + bucketSide - 1) / bucketSide, -1);
 }
 
-std::pair<int, int> CGame::tryPlaceUnit() const {
-    int x, y;
-    std::cin >> x >> y;
-    while (!CPlayingBoard::canPlaceUnit(x - 1, y - 1)) {
-        std::cout << "This coordinates are unavailable, try again!" << '\n';
-        std::cin >> x >> y;
+void CSpatialIndex::add(int x, int y, fraction owner) {
+    int id;
+    if (freeEntries_.empty()) {
+        id = entries_.size();
+        entries_.emplace_back();
+    } else {
+        id = freeEntries_.back();
+        freeEntries_.pop_back();
     }
-    return std::make_pair(x, y);
-}
-
-void CGame::placeLeader(fraction fraction) {
-    std::cout << (fraction == attacking ? "Attacking" : "Defending")  << " player, please enter the coordinates of the "
-                                                                         "position of your leader, separated by whitespace, "
-                                                                         "correct coordinates are between 1 and " << boardSize
-                                                                         << "." << '\n';
-    std::pair<int, int> correctPosition = tryPlaceUnit();
-    int x = correctPosition.first, y = correctPosition.second;
-    CUnit* leader = (fraction == attacking ? attackingFactory->createLeader() : defendingFactory->createLeader());
-    CPlayingBoard::placeUnit(x - 1, y - 1, leader);
-    CPlayingBoard::printBoard();
-    placeUnit(fraction, (fraction == attacking ? attackingUnits : defendingUnits));
+    int& head = heads_[owner].at(x / bucketSide, y / bucketSide);
+    entries_[id] = CEntry{x, y, owner, -1, head};
+    if (head != -1) {
+        entries_[head].prev = id;
+    }
+    head = id;
+    entryAt_.set(x, y, id);
+    size_++;
 }
 
-void CGame::placeUnit(fraction fraction, int unitsLeft) {
-    if (unitsLeft == 0 and fraction == defending) {
-        return;
-    } else if (unitsLeft == 0 and fraction == attacking) {
-        placeLeader(defending);
+void CSpatialIndex::remove(int x, int y) {
+    int id = entryAt_.get(x, y);
+    if (id == -1) {
         return;
     }
-    std::cout << "You can place infantry or shooter: enter 1 to place infantry and 2 to place shooter." << '\n';
-    int warriorType;
-    std::cin >> warriorType;
-    while (warriorType != 1 and warriorType != 2) {
+    const CEntry& entry = entries_[id];
+    if (entry.prev != -1) {
+        entries_[entry.prev].next = entry.next;
+    } else {
+        heads_[entry.owner].at(x / bucketSide, y / bucketSide) = entry.next;
+    }
+    if (entry.next != -1) {
+        entries_[entry.next].prev = entry.prev;
+    }
+    entryAt_.set(x, y, -1);
+    freeEntries_.push_back(id);
+    size_--;
+}
+
+size_t CSpatialIndex::size() const {
+    return size_;
+}
+
+template <typename Visitor>
+void CSpatialIndex::forEachInRadius(fraction owner, int x, int y, int radius, Visitor visitor) const {
+    int buckets = heads_[owner].side();
+    int firstX = std::max(x - radius, 0) / bucketSide, lastX = std::min((x + radius) / bucketSide, buckets - 1);
+    int firstY = std::max(y - radius, 0) / bucketSide, lastY = std::min((y + radius) / bucketSide, buckets - 1);
+    for (int i = firstX; i <= lastX; ++i) {
+        for (int j = firstY; j <= lastY; ++j) {
+            for (int id = heads_[owner].get(i, j); id != -1; id = entries_[id].next) {
+                const CEntry& entry = entries_[id];
+                if (std::abs(entry.x - x) + std::abs(entry.y - y) <= radius) {
+                    visitor(entry.x, entry.y);
+                }
+            }
+        }
+    }
+}
+
+CLargeBoard::CLargeBoard(int side): index_(side) {
+    for (int f = 0; f < 2; ++f) {
+        threats_[f] = CTiledGrid<uint8_t>(side, 0);
+        leaders_[f] = std::make_pair(-1, -1);
+    }
+}
+
+const CSpatialIndex& CLargeBoard::index() const {
+    return index_;
+}
+
+void CLargeBoard::addThreats(int x, int y, fraction fraction, warriorType type, int delta) {
+    if (type == leader) {
+        leaders_[fraction] = (delta > 0 ? std::make_pair(x, y) : std::make_pair(-1, -1));
+    }
+    CReach reach = unitStats[fraction][type].attack;
+    int side = threats_[fraction].side();
+    for (int cur_x = std::max(0, x - reach.maxDistance); cur_x <= std::min(side - 1, x + reach.maxDistance); ++cur_x) {
+        int width = reach.maxDistance - std::abs(cur_x - x), gap = reach.minDistance - std::abs(cur_x - x);
+        for (int cur_y = std::max(0, y - width); cur_y <= std::min(side - 1, y + width); ++cur_y) {
+            if (std::abs(cur_y - y) >= gap) { // the squares nearer than minDistance stay out of the ring
+                threats_[fraction].at(cur_x, cur_y) += delta;
+            }
+        }
+    }
+}
+
+int CLargeBoard::threatCount(fraction fraction, int x, int y) const {
+    int side = threats_[fraction].side();
+    return x >= 0 && x < side && y >= 0 && y < side ? threats_[fraction].get(x, y) : 0;
+}
+
+bool CLargeBoard::leaderInDanger() const {
+    return leaders_[defending].first != -1 && threatCount(attacking, leaders_[defending].first,
+                                                          leaders_[defending].second) > 0;
+}
+
+void CLargeBoard::moveComposite(CComposite& composite, std::pair<int, int> nodePair, int xOffset, int yOffset) {
+    if (canMoveComposite(composite, nodePair, xOffset, yOffset)) {
+        moveSquad(composite, composite.getNode(nodePair.first, nodePair.second), xOffset, yOffset);
+    }
+}
+
+void CLargeBoard::shiftNodes(CComposite& composite, int node, int xOffset, int yOffset) {
+    composite.moveNode(node, xOffset, yOffset);
+}
+
+bool inReach(CReach reach, int xOffset, int yOffset) {
+    int distance = std::abs(xOffset) + std::abs(yOffset);
+    return reach.minDistance <= distance && distance <= reach.maxDistance;
+}
+
+template <int Side>
+struct CGridCells { // the side is a constant, so the compiler folds the index arithmetic
+    std::array<uint8_t, Side * Side> cells;
+
+    explicit CGridCells(int);
+    int side() const;
+    uint8_t get(int, int) const;
+    void set(int, int, uint8_t);
+};
+
+template <int Side>
+CGridCells<Side>::CGridCells(int) {
+    cells.fill(0);
+}
+
+template <int Side>
+int CGridCells<Side>::side() const {
+    return Side;
+}
+
+template <int Side>
+uint8_t CGridCells<Side>::get(int x, int y) const {
+    return cells[x * Side + y];
+}
+
+template <int Side>
+void CGridCells<Side>::set(int x, int y, uint8_t value) {
+    cells[x * Side + y] = value;
+}
+
+template <>
+struct CGridCells<0> { // any other side, known at run time only, the tiles without units take no memory
+    CTiledGrid<uint8_t> cells;
+
+    explicit CGridCells(int);
+    int side() const;
+    uint8_t get(int, int) const;
+    void set(int, int, uint8_t);
+};
+
+CGridCells<0>::CGridCells(int side): cells(side, 0) {}
+
+int CGridCells<0>::side() const {
+    return cells.side();
+}
+
+uint8_t CGridCells<0>::get(int x, int y) const {
+    return cells.get(x, y);
+}
+
+void CGridCells<0>::set(int x, int y, uint8_t value) {
+    cells.set(x, y, value);
+}
+
+template <int Side>
+class CGridBoard: public CLargeBoard { // a cell holds 0 if empty, else 1 + 3 * fraction + warriorType
+private:
+    CGridCells<Side> cells_;
+    std::vector<std::pair<std::pair<int, int>, uint8_t> > moving_; // reused by moveSquad
+
+    uint8_t cell(int, int) const;
+    bool inSquad(const CComposite&, int, int, int) const;
+public:
+    explicit CGridBoard(int);
+    ~CGridBoard() override = default;
+
+    int side() const override;
+    bool isOccupied(int, int) const override;
+    fraction getFraction(int, int) const override;
+    warriorType getWarriorType(int, int) const override;
+    bool canPlaceUnit(int, int) const override;
+    bool canMove(int, int, int, int) const override;
+    bool canAttack(int, int, int, int) const override;
+    bool canAttack(int, int) const override;
+    bool canMoveComposite(const CComposite&, std::pair<int, int>, int, int) const override;
+    void placeUnit(int, int, fraction, warriorType) override;
+    void removeUnit(int, int) override;
+    void moveSquad(CComposite&, int, int, int) override;
+};
+
+template <int Side>
+CGridBoard<Side>::CGridBoard(int side): CLargeBoard(side), cells_(side) {}
+
+template <int Side>
+int CGridBoard<Side>::side() const {
+    return cells_.side();
+}
+
+template <int Side>
+uint8_t CGridBoard<Side>::cell(int x, int y) const {
+    return cells_.get(x, y);
+}
+
+template <int Side>
+bool CGridBoard<Side>::isOccupied(int x, int y) const {
+    return x >= 0 && x < cells_.side() && y >= 0 && y < cells_.side() && cell(x, y) != 0;
+}
+
+template <int Side>
+fraction CGridBoard<Side>::getFraction(int x, int y) const {
+    return fraction((cell(x, y) - 1) / 3);
+}
+
+template <int Side>
+warriorType CGridBoard<Side>::getWarriorType(int x, int y) const {
+    return warriorType((cell(x, y) - 1) % 3);
+}
+
+template <int Side>
+bool CGridBoard<Side>::canPlaceUnit(int x, int y) const {
+    return x >= 0 && x < cells_.side() && y >= 0 && y < cells_.side() && cell(x, y) == 0;
+}
+
+template <int Side>
+bool CGridBoard<Side>::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
+    return isOccupied(cur_x, cur_y) && canPlaceUnit(new_x, new_y) &&
+           inReach(unitStats[getFraction(cur_x, cur_y)][getWarriorType(cur_x, cur_y)].move, new_x - cur_x,
+                   new_y - cur_y);
+}
+
+template <int Side>
+bool CGridBoard<Side>::canAttack(int cur_x, int cur_y, int new_x, int new_y) const {
+    return isOccupied(cur_x, cur_y) && isOccupied(new_x, new_y) &&
+           getFraction(cur_x, cur_y) != getFraction(new_x, new_y) &&
+           inReach(unitStats[getFraction(cur_x, cur_y)][getWarriorType(cur_x, cur_y)].attack, new_x - cur_x,
+                   new_y - cur_y);
+}
+
+template <int Side>
+bool CGridBoard<Side>::canAttack(int x, int y) const {
+    if (!isOccupied(x, y)) {
+        return false;
+    }
+    CReach reach = unitStats[getFraction(x, y)][getWarriorType(x, y)].attack;
+    bool found = false;
+    index_.forEachInRadius(getFraction(x, y) == attacking ? defending : attacking, x, y, reach.maxDistance,
+                           [&found, reach, x, y](int enemyX, int enemyY) {
+        found = found || inReach(reach, enemyX - x, enemyY - y);
+    });
+    return found;
+}
+
+template <int Side>
+bool CGridBoard<Side>::inSquad(const CComposite& composite, int squad, int x, int y) const {
+    for (int node = composite.getNode(x, y); node != -1; node = composite.node(node).getParent()) {
+        if (node == squad) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <int Side>
+bool CGridBoard<Side>::canMoveComposite(const CComposite& composite, std::pair<int, int> nodePair, int xOffset,
+                                        int yOffset) const {
+    int ptr = composite.getNode(nodePair.first, nodePair.second);
+    if (ptr == -1) {
+        return false;
+    }
+    bool inRing[7] = {false}; // by cell code, the offset does not change along the squad
+    for (int code = 1; code < 7; ++code) {
+        inRing[code] = inReach(unitStats[(code - 1) / 3][(code - 1) % 3].move, xOffset, yOffset);
+    }
+    for (int cur = ptr; cur != -1; cur = composite.nextInSubtree(ptr, cur)) {
+        std::pair<int, int> component = composite.node(cur).getSavedComponent();
+        if (component.first == -1) {
+            continue;
+        }
+        int new_x = component.first + xOffset, new_y = component.second + yOffset;
+        if (!isOccupied(component.first, component.second) || !inRing[cell(component.first, component.second)] ||
+            !(canPlaceUnit(new_x, new_y) || (isOccupied(new_x, new_y) && inSquad(composite, ptr, new_x, new_y)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <int Side>
+void CGridBoard<Side>::placeUnit(int x, int y, fraction fraction, warriorType type) {
+    cells_.set(x, y, 1 + 3 * fraction + type);
+    index_.add(x, y, fraction);
+    addThreats(x, y, fraction, type, 1);
+}
+
+template <int Side>
+void CGridBoard<Side>::removeUnit(int x, int y) {
+    if (isOccupied(x, y)) {
+        addThreats(x, y, getFraction(x, y), getWarriorType(x, y), -1);
+    }
+    cells_.set(x, y, 0);
+    index_.remove(x, y);
+}
+
+template <int Side>
+void CGridBoard<Side>::moveSquad(CComposite& composite, int ptr, int xOffset, int yOffset) {
+    moving_.clear();
+    for (int cur = ptr; cur != -1; cur = composite.nextInSubtree(ptr, cur)) {
+        std::pair<int, int> component = composite.node(cur).getSavedComponent();
+        if (component.first != -1) {
+            moving_.emplace_back(std::make_pair(component.first + xOffset, component.second + yOffset),
+                                 cell(component.first, component.second));
+            removeUnit(component.first, component.second);
+        }
+    }
+    for (size_t i = 0; i < moving_.size(); ++i) {
+        placeUnit(moving_[i].first.first, moving_[i].first.second, fraction((moving_[i].second - 1) / 3),
+                  warriorType((moving_[i].second - 1) % 3));
+    }
+    shiftNodes(composite, ptr, xOffset, yOffset);
+}
+
+std::unique_ptr<CLargeBoard> makeLargeBoard(int side) {
+    if (side == 16) {
+        return std::unique_ptr<CLargeBoard>(new CGridBoard<16>(side));
+    } else if (side == 32) {
+        return std::unique_ptr<CLargeBoard>(new CGridBoard<32>(side));
+    }
+    return std::unique_ptr<CLargeBoard>(new CGridBoard<0>(side));
+}
+
+thread_local CPlayingBoard* currentBoard = nullptr;
+
+int playingBoardSide(int side) {
+    if (side < 1 || side > maxBoardSide) {
+        throw std::invalid_argument("a playing board has from 1 to " + std::to_string(maxBoardSide) +
+                                    " squares a side, not " + std::to_string(side));
+    }
+    return side;
+}
+
+CPlayingBoard::CPlayingBoard(int side): side_(playingBoardSide(side)), bits_(std::min(side_, boardSize)) {
+    board();
+}
+
+CPlayingBoard& CPlayingBoard::current() {
+    thread_local CPlayingBoard ownBoard;
+    return currentBoard != nullptr ? *currentBoard : ownBoard;
+}
+
+void CPlayingBoard::setCurrent(CPlayingBoard* board) {
+    currentBoard = board;
+}
+
+std::shared_ptr<const std::vector<std::vector<CUnit*> > > CPlayingBoard::board() {
+    if (side_ > boardSize) { // a dense desk of this side would be mostly null pointers
+        if (large_ == nullptr) {
+            large_ = makeLargeBoard(side_);
+            units_ = CTiledGrid<CUnit*>(side_, nullptr);
+        }
+        return nullptr;
+    }
+    if (desk_ == nullptr) {
+        desk_ = std::make_shared<std::vector<std::vector<CUnit*> > >(std::vector<std::vector<CUnit*> >(side_,
+                std::vector<CUnit*>(side_, nullptr)));
+        bits_.clear();
+    }
+    return desk_;
+}
+
+CUnit*& CPlayingBoard::cell(int x, int y) {
+    if (large_ == nullptr && desk_ == nullptr) {
+        throw std::logic_error("the board was deleted, board() makes a new one before it can be changed");
+    }
+    return large_ != nullptr ? units_.at(x, y) : desk_->at(x)[y];
+}
+
+int CPlayingBoard::side() const {
+    return side_;
+}
+
+const CUnit* CPlayingBoard::unitAt(int x, int y) const {
+    if (x < 0 || x >= side_ || y < 0 || y >= side_) {
+        return nullptr;
+    }
+    if (large_ != nullptr) {
+        return units_.get(x, y);
+    }
+    return desk_ != nullptr ? desk_->at(x)[y] : nullptr;
+}
+
+template <typename Visitor>
+void CPlayingBoard::forEachUnit(Visitor visitor) const {
+    if (large_ != nullptr) {
+        units_.forEach(visitor);
+        return;
+    }
+    for (uint64_t rest = (desk_ != nullptr ? bits_.occupied() : 0); rest != 0; rest &= rest - 1) {
+        int cur = __builtin_ctzll(rest);
+        visitor(cur / boardSize, cur % boardSize, desk_->at(cur / boardSize)[cur % boardSize]);
+    }
+}
+
+void CPlayingBoard::enemiesInRadius(int x, int y, int radius, std::vector<std::pair<int, int> >& found) const {
+    found.clear();
+    const CUnit* unit = unitAt(x, y);
+    if (unit == nullptr) {
+        return;
+    }
+    fraction enemy = (unit->getFraction() == attacking ? defending : attacking);
+    if (large_ != nullptr) {
+        large_->index().forEachInRadius(enemy, x, y, radius, [&found](int enemyX, int enemyY) {
+            found.emplace_back(enemyX, enemyY);
+        });
+        return;
+    }
+    for (uint64_t rest = bits_.fractionMask(enemy); rest != 0; rest &= rest - 1) { // a few dozen units at most
+        int cur = __builtin_ctzll(rest);
+        if (std::abs(cur / boardSize - x) + std::abs(cur % boardSize - y) <= radius) {
+            found.emplace_back(cur / boardSize, cur % boardSize);
+        }
+    }
+}
+
+int CPlayingBoard::threatCount(fraction fraction, int x, int y) const {
+    if (large_ != nullptr) {
+        return large_->threatCount(fraction, x, y);
+    }
+    return bits_.threatCount(fraction, x, y);
+}
+
+bool CPlayingBoard::leaderInDanger() const {
+    if (large_ != nullptr) {
+        return large_->leaderInDanger();
+    }
+    return bits_.leaderInDanger();
+}
+
+const CBitBoard& CPlayingBoard::bitBoard() const {
+    return bits_;
+}
+
+CPlayingBoard::~CPlayingBoard() {
+    deleteBoard();
+}
+
+bool CPlayingBoard::canMove(int cur_x, int cur_y, int new_x, int new_y) const {
+    if (large_ != nullptr) {
+        return large_->canMove(cur_x, cur_y, new_x, new_y);
+    }
+    return bits_.canMove(cur_x, cur_y, new_x, new_y);
+}
+
+bool CPlayingBoard::canAttack(int cur_x, int cur_y, int new_x, int new_y) const {
+    if (large_ != nullptr) {
+        return large_->canAttack(cur_x, cur_y, new_x, new_y);
+    }
+    return bits_.canAttack(cur_x, cur_y, new_x, new_y);
+}
+
+bool CPlayingBoard::canPlaceUnit(int cur_x, int cur_y) const {
+    if (large_ != nullptr) {
+        return large_->canPlaceUnit(cur_x, cur_y);
+    }
+    return desk_ != nullptr && bits_.canPlaceUnit(cur_x, cur_y);
+}
+
+void CPlayingBoard::placeUnit(int cur_x, int cur_y, CUnit* unit) {
+    cell(cur_x, cur_y) = unit;
+    if (large_ != nullptr) {
+        large_->placeUnit(cur_x, cur_y, unit->getFraction(), unit->getWarriorType());
+    } else {
+        bits_.placeUnit(cur_x, cur_y, unit->getFraction(), unit->getWarriorType(), unit->getHealth());
+    }
+}
+
+void CPlayingBoard::removeUnit(int cur_x, int cur_y) {
+    CUnit*& unit = cell(cur_x, cur_y);
+    delete unit;
+    unit = nullptr;
+    if (large_ != nullptr) {
+        large_->removeUnit(cur_x, cur_y);
+    } else {
+        bits_.removeUnit(cur_x, cur_y);
+    }
+}
+
+void CPlayingBoard::attack(int cur_x, int cur_y, int new_x, int new_y) {
+    reduceHealth(new_x, new_y, cell(cur_x, cur_y)->getDamage());
+}
+
+void CPlayingBoard::reduceHealth(int x, int y, int loss) {
+    cell(x, y)->reduceHealth(loss);
+    if (large_ == nullptr) { // large boards keep no health, the units do
+        bits_.reduceHealth(x, y, loss);
+    }
+}
+
+void CPlayingBoard::deleteBoard() {
+    units_.forEach([](int, int, CUnit* unit) {
+        delete unit;
+    });
+    units_.clear();
+    large_.reset();
+    if (desk_ == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < desk_->size(); ++i) {
+        for (size_t l = 0; l < desk_->at(i).size(); ++l) {
+            if (desk_->at(i)[l] != nullptr) {
+                delete desk_->at(i)[l];
+            }
+        }
+    }
+    desk_.reset();
+    bits_.clear();
+}
+
+CFactoryDecorator::CFactoryDecorator(CArmyFactory* factory): controlledFactory(factory) {}
+
+CUnit* CFactoryDecorator::createLeader() const {
+    std::cout << "New leader created!" << '\n';
+    return controlledFactory->createLeader();
+}
+
+CUnit* CFactoryDecorator::createInfantry() const {
+    std::cout << "New infantry created!" << '\n';
+    return controlledFactory->createInfantry();
+}
+
+CUnit* CFactoryDecorator::createShooter() const {
+    std::cout << "New shooter created!" << '\n';
+    return controlledFactory->createShooter();
+}
+
+CNode::CNode(int x, int y, int depth): depth_(depth), movedTurn_(0), soldiers_(x != -1), moved_(0), countedTurn_(0),
+        parent_(-1), firstChild_(-1), lastChild_(-1), prevSibling_(-1), nextSibling_(-1) {
+    savedComponent_ = std::make_pair(x, y);
+}
+
+std::pair<int, int> CNode::getSavedComponent() const {
+    return savedComponent_;
+}
+
+int CNode::getDepth() const {
+    return depth_;
+}
+
+int CNode::getParent() const {
+    return parent_;
+}
+
+int CNode::getFirstChild() const {
+    return firstChild_;
+}
+
+int CNode::getLastChild() const {
+    return lastChild_;
+}
+
+int CNode::getPrevSibling() const {
+    return prevSibling_;
+}
+
+int CNode::getNextSibling() const {
+    return nextSibling_;
+}
+
+CComposite::CComposite(fraction fraction, const CPlayingBoard& board): fraction_(fraction), turn_(1), movedMask_(0),
+        hash_(0) {
+    build(board);
+}
+
+CComposite::CComposite(fraction fraction, const CBitBoard& board): fraction_(fraction), turn_(1), movedMask_(0),
+        hash_(0) {
+    build(board);
+}
+
+void CComposite::build(const CBitBoard& board) {
+    soldierAt_ = CTiledGrid<int>(boardSize, -1);
+    int ptr = allocateNode(-1, 1, 1);
+    for (int i = 2; i != maxCompositeDepth; ++i) {
+        ptr = addNode(ptr, -1, i);
+    }
+    for (int i = 0; i < boardSize; ++i) {
+        for (int j = 0; j < boardSize; ++j) {
+            if (board.isOccupied(i, j) && board.getFraction(i, j) == fraction_) {
+                addNode(ptr, i, j);
+            }
+        }
+    }
+}
+
+void CComposite::build(const CPlayingBoard& board) {
+    soldierAt_ = CTiledGrid<int>(std::max(boardSize, board.side()), -1);
+    int ptr = allocateNode(-1, 1, 1);
+    for (int i = 2; i != maxCompositeDepth; ++i) {
+        ptr = addNode(ptr, -1, i);
+    }
+    std::vector<std::pair<int, int> > soldiers; // the occupied tiles only, a large board is mostly empty
+    board.forEachUnit([this, &soldiers](int x, int y, const CUnit* unit) {
+        if (unit->getFraction() == fraction_) {
+            soldiers.emplace_back(x, y);
+        }
+    });
+    std::sort(soldiers.begin(), soldiers.end()); // tiles come out of order, the soldiers join row by row
+    for (size_t i = 0; i < soldiers.size(); ++i) {
+        addNode(ptr, soldiers[i].first, soldiers[i].second);
+    }
+}
+
+int CComposite::allocateNode(int x, int y, int depth) {
+    int node;
+    if (freeNodes_.empty()) {
+        node = nodes_.size();
+        nodes_.push_back(CNode(x, y, depth));
+    } else {
+        node = freeNodes_.back();
+        freeNodes_.pop_back();
+        nodes_[node] = CNode(x, y, depth);
+    }
+    if (x == -1) {
+        if (y >= static_cast<int>(structureAt_.size())) {
+            structureAt_.resize(y + 1, -1);
+        }
+        structureAt_[y] = node;
+    } else {
+        soldierAt_.set(x, y, node);
+    }
+    return node;
+}
+
+uint64_t CComposite::linkKey(int child) const { // the node and its parent, by their squares or structure numbers
+    std::pair<int, int> own = nodes_[child].savedComponent_, parent = nodes_[nodes_[child].parent_].savedComponent_;
+    uint64_t seed = (uint64_t(fraction_) << 56) ^ (uint64_t(own.first + 1) << 42) ^ (uint64_t(own.second) << 28) ^
+                    (uint64_t(parent.first + 1) << 14) ^ uint64_t(parent.second);
+    return splitMix64(seed);
+}
+
+void CComposite::linkChild(int parent, int child, int prevSibling) {
+    CNode& node = nodes_[child];
+    node.parent_ = parent;
+    node.prevSibling_ = prevSibling;
+    hash_ ^= linkKey(child);
+    if (prevSibling != -1) {
+        node.nextSibling_ = nodes_[prevSibling].nextSibling_;
+        nodes_[prevSibling].nextSibling_ = child;
+    } else {
+        node.nextSibling_ = nodes_[parent].firstChild_;
+        nodes_[parent].firstChild_ = child;
+    }
+    if (node.nextSibling_ != -1) {
+        nodes_[node.nextSibling_].prevSibling_ = child;
+    } else {
+        nodes_[parent].lastChild_ = child;
+    }
+    addCounts(parent, node.soldiers_, movedIn(child));
+}
+
+void CComposite::unlinkNode(int child) {
+    CNode& node = nodes_[child];
+    hash_ ^= linkKey(child);
+    addCounts(node.parent_, -node.soldiers_, -movedIn(child));
+    if (node.prevSibling_ != -1) {
+        nodes_[node.prevSibling_].nextSibling_ = node.nextSibling_;
+    } else {
+        nodes_[node.parent_].firstChild_ = node.nextSibling_;
+    }
+    if (node.nextSibling_ != -1) {
+        nodes_[node.nextSibling_].prevSibling_ = node.prevSibling_;
+    } else {
+        nodes_[node.parent_].lastChild_ = node.prevSibling_;
+    }
+    node.parent_ = node.prevSibling_ = node.nextSibling_ = -1;
+}
+
+int CComposite::movedIn(int node) const {
+    return nodes_[node].countedTurn_ == turn_ ? nodes_[node].moved_ : 0;
+}
+
+void CComposite::addCounts(int node, int soldiers, int moved) { // the node and its ancestors
+    for (int cur = node; cur != -1; cur = nodes_[cur].parent_) {
+        CNode& ptr = nodes_[cur];
+        if (ptr.countedTurn_ != turn_) {
+            ptr.countedTurn_ = turn_;
+            ptr.moved_ = 0;
+        }
+        ptr.soldiers_ += soldiers;
+        ptr.moved_ += moved;
+    }
+}
+
+uint64_t CComposite::squareBit(int x, int y) const {
+    return soldierAt_.side() == boardSize ? CBitBoard::squareMask(x, y) : 0;
+}
+
+void CComposite::markMoved(int node) {
+    if (nodes_[node].movedTurn_ != turn_) {
+        nodes_[node].movedTurn_ = turn_;
+        addCounts(node, 0, 1);
+    }
+    movedMask_ |= squareBit(nodes_[node].savedComponent_.first, nodes_[node].savedComponent_.second);
+}
+
+bool CComposite::isMoved(int node) const {
+    return nodes_[node].movedTurn_ == turn_;
+}
+
+bool CComposite::allMoved(int node) const {
+    return movedIn(node) == nodes_[node].soldiers_;
+}
+
+bool CComposite::allUnmoved(int node) const {
+    return movedIn(node) == 0;
+}
+
+bool CComposite::canAdopt(int parent, int x) const {
+    if (x == -1) {
+        return nodes_[parent].depth_ < maxCompositeDepth - 1;
+    }
+    return nodes_[parent].depth_ == maxCompositeDepth - 1;
+}
+
+int CComposite::addNode(int parent, int x, int y) {
+    if (!canAdopt(parent, x)) {
+        return -1;
+    }
+    int node = allocateNode(x, y, nodes_[parent].depth_ + 1);
+    linkChild(parent, node, nodes_[parent].lastChild_);
+    return node;
+}
+
+void CComposite::relinkNode(int node, int parent, int prevSibling) {
+    unlinkNode(node);
+    linkChild(parent, node, prevSibling);
+}
+
+int CComposite::restoreNode(int x, int y, int parent, int prevSibling) {
+    int node = allocateNode(x, y, nodes_[parent].depth_ + 1);
+    linkChild(parent, node, prevSibling);
+    return node;
+}
+
+bool CComposite::removeNode(int node) {
+    if (node <= 0 || nodes_[node].firstChild_ != -1) {
+        return false;
+    }
+    unlinkNode(node);
+    std::pair<int, int> component = nodes_[node].savedComponent_;
+    if (component.first == -1) {
+        structureAt_[component.second] = -1;
+    } else {
+        soldierAt_.set(component.first, component.second, -1);
+        movedMask_ &= ~squareBit(component.first, component.second);
+    }
+    nodes_[node].depth_ = 0;
+    freeNodes_.push_back(node);
+    return true;
+}
+
+int CComposite::nextInSubtree(int root, int node) const {
+    if (nodes_[node].firstChild_ != -1) {
+        return nodes_[node].firstChild_;
+    }
+    while (node != root) {
+        if (nodes_[node].nextSibling_ != -1) {
+            return nodes_[node].nextSibling_;
+        }
+        node = nodes_[node].parent_;
+    }
+    return -1;
+}
+
+const CNode& CComposite::node(int node) const {
+    return nodes_[node];
+}
+
+int CComposite::getNode(int x, int y) const {
+    if (x == -1) {
+        return y >= 0 && y < static_cast<int>(structureAt_.size()) ? structureAt_[y] : -1;
+    }
+    return x >= 0 && x < soldierAt_.side() && y >= 0 && y < soldierAt_.side() ? soldierAt_.get(x, y) : -1;
+}
+
+void CComposite::printComposite() const {
+    std::queue<int> q;
+    q.push(getTopNode());
+    while (!q.empty()) {
+        const CNode& ptr = nodes_[q.front()];
+        q.pop();
+        if (ptr.savedComponent_.first == -1) {
+            std::cout << "Structure № " << ptr.savedComponent_.second << " " << structureNames[ptr.depth_ - 1] << "."
+                      << '\n';
+            std::cout << "Children: ";
+            std::vector<std::pair<std::pair<int, int>, int> > children;
+            for (int child = ptr.firstChild_; child != -1; child = nodes_[child].nextSibling_) {
+                children.push_back(std::make_pair(nodes_[child].savedComponent_, child));
+            }
+            std::sort(children.begin(), children.end());
+            for (size_t i = 0; i < children.size(); ++i) {
+                q.push(children[i].second);
+                std::cout << structureNames[nodes_[children[i].second].depth_ - 1] << " ";
+                if (children[i].first.first != -1) {
+                    std::cout << children[i].first.first << ", ";
+                }
+                std::cout << children[i].first.second << "; ";
+            }
+            std::cout << '\n';
+        }
+    }
+}
+
+bool CComposite::addChild(int x) {
+    int ptr = getNode(-1, x);
+    if (ptr == -1 || !canAdopt(ptr, -1)) {
+        return false;
+    }
+    int num = 1;
+    while (getNode(-1, num) != -1) {
+        num++;
+    }
+    return addNode(ptr, -1, num) != -1;
+}
+
+int CComposite::getParentNode(int x, int y) const {
+    int node = getNode(x, y);
+    return node == -1 ? -1 : nodes_[node].parent_;
+}
+
+bool CComposite::removeChild(int x, int y) {
+    int node = getNode(x, y);
+    return node != -1 && removeNode(node);
+}
+
+bool CComposite::switchChild (int x, int y, int comp_num) {
+    int node = getNode(x, y);
+    if (node == -1 || x == -1) {
+        return false;
+    }
+    int futureComponent = getNode(-1, comp_num);
+    if (futureComponent == -1 || nodes_[futureComponent].depth_ != maxCompositeDepth - 1) {
+        return false;
+    }
+    relinkNode(node, futureComponent, nodes_[futureComponent].lastChild_);
+    return true;
+}
+
+void CComposite::moveNode(int root, int xOffset, int yOffset) {
+    for (int cur = root; cur != -1; cur = nextInSubtree(root, cur)) {
+        CNode& node = nodes_[cur];
+        if (node.savedComponent_.first != -1) {
+            hash_ ^= linkKey(cur);
+            soldierAt_.set(node.savedComponent_.first, node.savedComponent_.second, -1);
+            movedMask_ &= ~squareBit(node.savedComponent_.first, node.savedComponent_.second);
+            node.savedComponent_.first += xOffset;
+            node.savedComponent_.second += yOffset;
+        }
+    }
+    for (int cur = root; cur != -1; cur = nextInSubtree(root, cur)) {
+        const CNode& node = nodes_[cur];
+        if (node.savedComponent_.first != -1) {
+            hash_ ^= linkKey(cur);
+            soldierAt_.set(node.savedComponent_.first, node.savedComponent_.second, cur);
+            markMoved(cur);
+        }
+    }
+}
+
+bool CPlayingBoard::canMoveComposite(const CComposite& composite, std::pair<int, int> nodePair, int xOffset,
+                                     int yOffset) const {
+    if (large_ != nullptr) {
+        return large_->canMoveComposite(composite, nodePair, xOffset, yOffset);
+    }
+    return bits_.canMoveComposite(composite, nodePair, xOffset, yOffset);
+}
+
+void CPlayingBoard::moveComposite(int x, int y, int xOffset, int yOffset, CComposite& composite) {
+    int ptr = composite.getNode(x, y);
+    if (ptr == -1) {
+        return;
+    }
+    uint64_t squad = 0; // checked once here, the boards below move it without checking again
+    if (large_ != nullptr ? !large_->canMoveComposite(composite, std::make_pair(x, y), xOffset, yOffset) :
+        !bits_.canMoveSquad(squad = CBitBoard::nodeMask(composite, ptr), xOffset, yOffset)) {
+        return;
+    }
+    moving_.clear();
+    for (int cur = ptr; cur != -1; cur = composite.nextInSubtree(ptr, cur)) {
+        if (composite.node(cur).getSavedComponent().first != -1) {
+            std::pair<int, int> curPair = composite.node(cur).getSavedComponent();
+            moving_.emplace_back(std::make_pair(curPair.first + xOffset, curPair.second + yOffset),
+                                 cell(curPair.first, curPair.second));
+            cell(curPair.first, curPair.second) = nullptr;
+        }
+    }
+    if (large_ != nullptr) {
+        large_->moveSquad(composite, ptr, xOffset, yOffset);
+    } else {
+        bits_.moveSquad(composite, ptr, squad, xOffset, yOffset); // shifts the masks and the node coordinates
+    }
+    for (size_t i = 0; i < moving_.size(); ++i) {
+        cell(moving_[i].first.first, moving_[i].first.second) = moving_[i].second;
+    }
+}
+
+int CComposite::getTopNode() const {
+    return 0;
+}
+
+bool CPlayingBoard::allMovedComposite(const CComposite& composite, int topNode, int i) {
+    if (composite.allMoved(topNode)) {
+        return true;
+    }
+    std::vector<std::pair<int, int> > unmovedUnits;
+    for (int cur = topNode; cur != -1; cur = composite.nextInSubtree(topNode, cur)) {
+        const CNode& node = composite.node(cur);
+        if (node.getSavedComponent().first != -1 && !composite.isMoved(cur)) {
+            unmovedUnits.push_back(node.getSavedComponent());
+        }
+    }
+    if (i > 0) {
+        std::cout << "This composite's components were unmoved on the iteration:" << '\n';
+        for (size_t i = 0; i < unmovedUnits.size(); ++i) {
+            std::cout << unmovedUnits[i].first << " " << unmovedUnits[i].second << '\n';
+        }
+    }
+    return false;
+}
+
+bool CPlayingBoard::allUnmovedComposite(const CComposite& composite, int topNode) {
+    return composite.allUnmoved(topNode);
+}
+
+void CComposite::startNewMove() { // the stamps of the old turn stop counting
+    turn_++;
+    movedMask_ = 0;
+}
+
+uint64_t CComposite::movedSoldiers() const {
+    return movedMask_;
+}
+
+uint64_t CComposite::hash() const {
+    return hash_;
+}
+
+uint64_t CComposite::computeHash() const {
+    uint64_t hash = 0;
+    for (int cur = nextInSubtree(getTopNode(), getTopNode()); cur != -1; cur = nextInSubtree(getTopNode(), cur)) {
+        hash ^= linkKey(cur);
+    }
+    return hash;
+}
+
+void CComposite::restoreMoved(uint64_t moved) {
+    startNewMove();
+    for (uint64_t rest = moved; rest != 0; rest &= rest - 1) {
+        int cur = __builtin_ctzll(rest);
+        markMoved(soldierAt_.get(cur / boardSize, cur % boardSize));
+    }
+}
+
+void CVisitor::visit(CDefendingInfantry) const {
+    std::cout << "1";
+}
+
+void CVisitor::visit(CDefendingShooter) const {
+    std::cout << "2";
+}
+
+void CVisitor::visit(CDefendingLeader) const {
+    std::cout << "3";
+}
+
+void CVisitor::visit(CAttackingInfantry) const {
+    std::cout << "7";
+}
+
+void CVisitor::visit(CAttackingShooter) const {
+    std::cout << "8";
+}
+
+void CVisitor::visit(CAttackingLeader) const {
+    std::cout << "9";
+}
+
+void CAttackingLeader::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CAttackingInfantry::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CAttackingShooter::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CDefendingLeader::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CDefendingInfantry::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CDefendingShooter::visit(CVisitor visitor) const {
+    visitor.visit(*this);
+}
+
+void CBitBoard::printBoard() const {
+    std::cout << "Current board:" << '\n';
+    CVisitor visitor = CVisitor();
+    for (int i = 0; i < side_; ++i) {
+        for (int l = 0; l < side_; ++l) {
+            if (!isOccupied(i, l)) {
+                std::cout << "x";
+            } else {
+                unitPrototype(getFraction(i, l), getWarriorType(i, l))->visit(visitor);
+            }
+            std::cout << " ";
+        }
+        std::cout << '\n';
+    }
+    std::cout << '\n' << "x - empty" << '\n';
+    std::cout << "1 - defending infantry" << '\n';
+    std::cout << "2 - defending shooter" << '\n';
+    std::cout << "3 - defending leader" << '\n';
+    std::cout << "7 - attacking infantry" << '\n';
+    std::cout << "8 - attacking shooter" << '\n';
+    std::cout << "9 - attacking leader" << '\n' << '\n';
+}
+
+void CPlayingBoard::printBoard() const {
+    if (large_ == nullptr) {
+        bits_.printBoard();
+        return;
+    }
+    std::cout << "Current board:" << '\n';
+    CVisitor visitor = CVisitor();
+    for (int i = 0; i < side_; ++i) {
+        for (int l = 0; l < side_; ++l) {
+            if (unitAt(i, l) == nullptr) {
+                std::cout << "x";
+            } else {
+                unitAt(i, l)->visit(visitor);
+            }
+            std::cout << " ";
+        }
+        std::cout << '\n';
+    }
+    std::cout << '\n';
+}
+
+bool CPlayingBoard::canAttack(int x, int y) const {
+    if (large_ != nullptr) {
+        return large_->canAttack(x, y);
+    }
+    return bits_.canAttack(x, y);
+}
+
+size_t CComposite::size() const {
+    return nodes_[getTopNode()].soldiers_;
+}
+
+
+CAction::CAction(actionType type, int x, int y, int targetX, int targetY, int number): type(type), x(x), y(y),
+        targetX(targetX), targetY(targetY), number(number) {}
+
+bool operator ==(const CAction& a, const CAction& b) {
+    return a.type == b.type && a.x == b.x && a.y == b.y && a.targetX == b.targetX && a.targetY == b.targetY &&
+           a.number == b.number;
+}
+
+CGameConfig::CGameConfig(): boardSide(boardSize) {
+    units[attacking] = attackingUnits;
+    units[defending] = defendingUnits;
+}
+
+bool CGameConfig::set(const std::string& key, int value) {
+    if (key == "size" && value >= 2 && value <= maxBoardSide) {
+        boardSide = value;
+    } else if ((key == "attacking_units" || key == "defending_units") && value >= 0 &&
+               value < maxBoardSide * maxBoardSide / 2) {
+        units[key == "attacking_units" ? attacking : defending] = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool CGameConfig::fits() const {
+    return units[attacking] + units[defending] + 2 <= boardSide * boardSide;
+}
+
+bool readConfig(std::istream& in, CGameConfig& config) {
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string key;
+        int value = 0;
+        if (!(words >> key)) {
+            continue;
+        }
+        if (!(words >> value) || !config.set(key, value)) {
+            return false;
+        }
+    }
+    return config.fits();
+}
+
+int rulesBoardSide(const CGameConfig& config) {
+    if (config.boardSide > boardSize) {
+        throw std::invalid_argument("the rules engine plays on boards of at most " + std::to_string(boardSize) +
+                                    " squares a side, larger boards run in CBattle only");
+    }
+    return config.boardSide;
+}
+
+CGameState::CGameState(const CGameConfig& config): board_(rulesBoardSide(config)),
+        attackingComposite_(attacking, board_), defendingComposite_(defending, board_), phase_(placementPhase),
+        toMove_(attacking), winner_(attacking), config_(config), placedUnits_(0), attackCursor_(0) {}
+
+const CBitBoard& CGameState::board() const {
+    return board_;
+}
+
+const CGameConfig& CGameState::config() const {
+    return config_;
+}
+
+const CComposite& CGameState::composite(fraction fraction) const {
+    return fraction == attacking ? attackingComposite_ : defendingComposite_;
+}
+
+CComposite& CGameState::editableComposite(fraction fraction) {
+    return fraction == attacking ? attackingComposite_ : defendingComposite_;
+}
+
+gamePhase CGameState::phase() const {
+    return phase_;
+}
+
+fraction CGameState::toMove() const {
+    return toMove_;
+}
+
+fraction CGameState::winner() const {
+    return winner_;
+}
+
+int CGameState::placedUnits() const {
+    return placedUnits_;
+}
+
+std::pair<int, int> CGameState::attacker() const {
+    return std::make_pair(attackCursor_ / boardSize, attackCursor_ % boardSize);
+}
+
+uint64_t CGameState::hash() const {
+    const CZobristTable& keys = zobristTable();
+    uint64_t hash = board_.hash() ^ keys.side[toMove_] ^ keys.phase[phase_];
+    hash ^= attackingComposite_.hash() ^ defendingComposite_.hash(); // the squads decide which moves are legal
+    if (phase_ == attackPhase) {
+        hash ^= keys.attacker[attackCursor_];
+    } else if (phase_ == movePhase) { // the units left to move decide the legal actions
+        for (int f = 0; f < 2; ++f) {
+            for (uint64_t rest = composite(fraction(f)).movedSoldiers(); rest != 0; rest &= rest - 1) {
+                hash ^= keys.moved[f][__builtin_ctzll(rest)];
+            }
+        }
+    }
+    return hash;
+}
+
+bool CGameState::buildsComposites() const {
+    return phase_ == placementPhase && toMove_ == defending && placedUnits_ + 1 > config_.units[defending];
+}
+
+void CGameState::finishPlacement() {
+    placedUnits_ = 0;
+    if (toMove_ == attacking) {
+        toMove_ = defending;
+        return;
+    }
+    attackingComposite_ = CComposite(attacking, board_);
+    defendingComposite_ = CComposite(defending, board_);
+    phase_ = editCompositePhase;
+    toMove_ = attacking;
+}
+
+void CGameState::finishMovePhase() {
+    editableComposite(toMove_).startNewMove();
+    if (toMove_ == attacking) {
+        toMove_ = defending;
+        if (CPlayingBoard::allMovedComposite(defendingComposite_, defendingComposite_.getTopNode(), 0)) {
+            finishMovePhase();
+        }
+        return;
+    }
+    phase_ = attackPhase;
+    toMove_ = attacking;
+    attackCursor_ = 0;
+    nextAttacker();
+}
+
+void CGameState::nextAttacker() {
+    uint64_t pending = (attackCursor_ < boardSize * boardSize ?
+                        board_.attackers(toMove_) >> attackCursor_ << attackCursor_ : 0);
+    if (pending != 0) {
+        attackCursor_ = __builtin_ctzll(pending);
+        return;
+    }
+    attackCursor_ = 0;
+    if (toMove_ == attacking) {
+        toMove_ = defending;
+        nextAttacker();
+    } else {
+        phase_ = editCompositePhase;
+        toMove_ = attacking;
+    }
+}
+
+void addMoves(const CGameState& state, std::vector<CAction>& actions) {
+    CAction buffer[maxGeneratedMoves];
+    const CComposite& composite = state.composite(state.toMove());
+    size_t count = state.board().generateMoves(composite, buffer, maxGeneratedMoves);
+    if (count <= maxGeneratedMoves) {
+        actions.insert(actions.end(), buffer, buffer + count);
+        return;
+    }
+    size_t oldSize = actions.size();
+    actions.resize(oldSize + count);
+    state.board().generateMoves(composite, &actions[oldSize], count);
+}
+
+bool isLegalAction(const CGameState& state, const CAction& action) {
+    const CBitBoard& board = state.board();
+    const CComposite& composite = state.composite(state.toMove());
+    if (state.phase() == placementPhase) {
+        return action.type == placeAction && board.canPlaceUnit(action.x, action.y) &&
+               (action.number == leader || action.number == infantry || action.number == shooter) &&
+               (action.number == leader) == (state.placedUnits() == 0);
+    } else if (state.phase() == editCompositePhase) {
+        int structure = composite.getNode(-1, action.number);
+        if (action.type == addStructureAction) {
+            return structure != -1 && composite.node(structure).getDepth() < maxCompositeDepth - 1;
+        } else if (action.type == switchChildAction) {
+            return action.x != -1 && composite.getNode(action.x, action.y) != -1 && structure != -1 &&
+                   composite.node(structure).getDepth() == maxCompositeDepth - 1;
+        }
+        return action.type == endEditAction;
+    } else if (state.phase() == movePhase) {
+        if (action.type == passAction) {
+            return board.generateMoves(composite, nullptr, 0) == 0;
+        }
+        int node = composite.getNode(action.x, action.y);
+        return action.type == moveAction && node != -1 && CBitBoard::nodeMask(composite, node) != 0 &&
+               CPlayingBoard::allUnmovedComposite(composite, node) &&
+               board.canMoveComposite(composite, std::make_pair(action.x, action.y), action.targetX, action.targetY);
+    } else if (state.phase() == attackPhase) {
+        return action.type == attackAction && std::make_pair(action.x, action.y) == state.attacker() &&
+               board.canAttack(action.x, action.y, action.targetX, action.targetY);
+    }
+    return false;
+}
+
+void CGameState::play(const CAction& action) {
+    CComposite& composite = editableComposite(toMove_);
+    if (action.type == placeAction) {
+        warriorType type = static_cast<warriorType>(action.number);
+        board_.placeUnit(action.x, action.y, toMove_, type, unitStats[toMove_][type].health);
+        placedUnits_++;
+        if (placedUnits_ > config_.units[toMove_]) {
+            finishPlacement();
+        }
+    } else if (action.type == addStructureAction) {
+        composite.addChild(action.number);
+    } else if (action.type == switchChildAction) {
+        composite.switchChild(action.x, action.y, action.number);
+    } else if (action.type == endEditAction) {
+        composite.startNewMove();
+        if (toMove_ == attacking) {
+            toMove_ = defending;
+        } else {
+            phase_ = movePhase;
+            toMove_ = attacking;
+        }
+    } else if (action.type == moveAction) { // isLegalAction has checked the move
+        int node = composite.getNode(action.x, action.y);
+        board_.moveSquad(composite, node, CBitBoard::nodeMask(composite, node), action.targetX, action.targetY);
+        if (CPlayingBoard::allMovedComposite(composite, composite.getTopNode(), 0)) {
+            finishMovePhase();
+        }
+    } else if (action.type == passAction) {
+        finishMovePhase();
+    } else if (action.type == attackAction) {
+        fraction enemy = (toMove_ == attacking ? defending : attacking);
+        board_.attack(action.x, action.y, action.targetX, action.targetY);
+        if (board_.getHealth(action.targetX, action.targetY) <= 0) {
+            if (board_.getWarriorType(action.targetX, action.targetY) == leader && enemy == defending) {
+                phase_ = finishedPhase;
+                winner_ = toMove_;
+            }
+            board_.removeUnit(action.targetX, action.targetY);
+            editableComposite(enemy).removeChild(action.targetX, action.targetY);
+            if (editableComposite(enemy).size() == 0) {
+                phase_ = finishedPhase;
+                winner_ = toMove_;
+            }
+        }
+        if (phase_ != finishedPhase) {
+            attackCursor_ = CBitBoard::square(action.x, action.y) + 1;
+            nextAttacker();
+        }
+    }
+}
+
+bool applyAction(CGameState& state, const CAction& action) {
+    if (!isLegalAction(state, action)) {
+        return false;
+    }
+    state.play(action);
+    return true;
+}
+
+CUndoStack::CUndoStack(size_t capacity): records_(capacity), size_(0) {}
+
+size_t CUndoStack::size() const {
+    return size_;
+}
+
+void CUndoStack::clear() {
+    size_ = 0;
+}
+
+CUndoRecord& CUndoStack::push() {
+    if (size_ == records_.size()) {
+        records_.resize(2 * size_ + 1);
+    }
+    return records_[size_++];
+}
+
+const CUndoRecord& CUndoStack::pop() {
+    return records_[--size_];
+}
+
+bool makeAction(CGameState& state, const CAction& action, CUndoStack& stack) {
+    if (!isLegalAction(state, action)) {
+        return false;
+    }
+    CUndoRecord& record = stack.push();
+    record.action = action;
+    record.phase = state.phase_;
+    record.toMove = state.toMove_;
+    record.winner = state.winner_;
+    record.placedUnits = state.placedUnits_;
+    record.attackCursor = state.attackCursor_;
+    record.node = record.parent = record.prevSibling = record.unitId = -1;
+    const CComposite& composite = state.composite(state.toMove_);
+    if (action.type == switchChildAction || action.type == attackAction) {
+        const CComposite& owner = (action.type == attackAction ? state.composite(state.toMove_ == attacking ?
+                                                                                  defending : attacking) : composite);
+        int x = (action.type == attackAction ? action.targetX : action.x);
+        int y = (action.type == attackAction ? action.targetY : action.y);
+        record.node = owner.getNode(x, y);
+        record.parent = owner.node(record.node).getParent();
+        record.prevSibling = owner.node(record.node).getPrevSibling();
+        if (action.type == attackAction) {
+            record.unitId = state.board_.unitAt(x, y);
+            record.unit = state.board_.unit(record.unitId);
+        }
+    } else if (action.type == endEditAction || action.type == moveAction || action.type == passAction) {
+        record.moved[attacking] = state.attackingComposite_.movedSoldiers();
+        record.moved[defending] = state.defendingComposite_.movedSoldiers();
+    }
+    record.composites.clear();
+    if (action.type == placeAction && state.buildsComposites()) {
+        record.composites.push_back(state.defendingComposite_);
+        record.composites.push_back(state.attackingComposite_);
+    }
+    state.play(action);
+    if (action.type == addStructureAction) {
+        record.node = composite.node(composite.getNode(-1, action.number)).getLastChild();
+    }
+    return true;
+}
+
+void unmakeAction(CGameState& state, CUndoStack& stack) {
+    const CUndoRecord& record = stack.pop();
+    const CAction& action = record.action;
+    gamePhase phase = state.phase_;
+    state.phase_ = record.phase;
+    state.toMove_ = record.toMove;
+    state.winner_ = record.winner;
+    state.placedUnits_ = record.placedUnits;
+    state.attackCursor_ = record.attackCursor;
+    CComposite& composite = state.editableComposite(state.toMove_);
+    if (action.type == placeAction) {
+        if (phase != placementPhase) { // the last placement built the composites
+            state.attackingComposite_ = record.composites.at(attacking);
+            state.defendingComposite_ = record.composites.at(defending);
+        }
+        state.board_.removeUnit(action.x, action.y);
+    } else if (action.type == addStructureAction) {
+        composite.removeNode(record.node);
+    } else if (action.type == switchChildAction) {
+        composite.relinkNode(record.node, record.parent, record.prevSibling);
+    } else if (action.type == attackAction) {
+        CComposite& enemy = state.editableComposite(state.toMove_ == attacking ? defending : attacking);
+        if (state.board_.unitAt(action.targetX, action.targetY) == -1) {
+            state.board_.restoreUnit(record.unitId, record.unit);
+            enemy.restoreNode(action.targetX, action.targetY, record.parent, record.prevSibling);
+        } else {
+            state.board_.reduceHealth(action.targetX, action.targetY,
+                                      state.board_.getHealth(action.targetX, action.targetY) - record.unit.health);
+        }
+    } else {
+        if (action.type == moveAction) {
+            std::pair<int, int> nodePair = (action.x == -1 ? std::make_pair(action.x, action.y) :
+                                            std::make_pair(action.x + action.targetX, action.y + action.targetY));
+            int node = composite.getNode(nodePair.first, nodePair.second); // the way back is always free
+            state.board_.moveSquad(composite, node, CBitBoard::nodeMask(composite, node), -action.targetX,
+                                   -action.targetY);
+        }
+        state.attackingComposite_.restoreMoved(record.moved[attacking]);
+        state.defendingComposite_.restoreMoved(record.moved[defending]);
+    }
+}
+
+std::vector<CAction> legalActions(const CGameState& state) {
+    std::vector<CAction> actions;
+    legalActions(state, actions);
+    return actions;
+}
+
+void legalActions(const CGameState& state, std::vector<CAction>& actions) {
+    actions.clear();
+    const CBitBoard& board = state.board();
+    if (state.phase() == placementPhase) {
+        for (int type = leader; type <= shooter; ++type) {
+            for (int x = 0; x < boardSize; ++x) {
+                for (int y = 0; y < boardSize; ++y) {
+                    CAction action(placeAction, x, y, 0, 0, type);
+                    if (isLegalAction(state, action)) {
+                        actions.push_back(action);
+                    }
+                }
+            }
+        }
+    } else if (state.phase() == editCompositePhase) {
+        actions.emplace_back(endEditAction);
+        const CComposite& composite = state.composite(state.toMove());
+        std::vector<int> squads;
+        std::vector<std::pair<std::pair<int, int>, int> > soldiers; // soldier and the number of its squad
+        int top = composite.getTopNode();
+        for (int cur = top; cur != -1; cur = composite.nextInSubtree(top, cur)) {
+            const CNode& node = composite.node(cur);
+            if (node.getSavedComponent().first != -1) {
+                soldiers.emplace_back(node.getSavedComponent(),
+                                      composite.node(node.getParent()).getSavedComponent().second);
+            } else if (node.getDepth() < maxCompositeDepth - 1) {
+                actions.emplace_back(addStructureAction, 0, 0, 0, 0, node.getSavedComponent().second);
+            } else {
+                squads.push_back(node.getSavedComponent().second);
+            }
+        }
+        for (size_t i = 0; i < soldiers.size(); ++i) {
+            for (size_t l = 0; l < squads.size(); ++l) {
+                if (squads[l] != soldiers[i].second) {
+                    actions.emplace_back(switchChildAction, soldiers[i].first.first, soldiers[i].first.second, 0, 0,
+                                         squads[l]);
+                }
+            }
+        }
+    } else if (state.phase() == movePhase) {
+        addMoves(state, actions);
+        if (actions.empty()) {
+            actions.emplace_back(passAction);
+        }
+    } else if (state.phase() == attackPhase) {
+        std::pair<int, int> unit = state.attacker();
+        for (uint64_t rest = board.targetsOf(unit.first, unit.second); rest != 0; rest &= rest - 1) {
+            int target = __builtin_ctzll(rest);
+            actions.emplace_back(attackAction, unit.first, unit.second, target / boardSize, target % boardSize);
+        }
+    }
+}
+
+bool isTerminal(const CGameState& state) {
+    return state.phase() == finishedPhase;
+}
+
+const int materialWeight = 10;    // per point of health times damage
+const int mobilityWeight = 1;     // per free square a unit can step to
+const int leaderThreatWeight = 40; // per attacking unit with the defending leader in reach
+
+int evaluate(const CGameState& state, fraction player) {
+    if (isTerminal(state)) {
+        return state.winner() == player ? winScore : -winScore;
+    }
+    const CBitBoard& board = state.board();
+    int score[2] = {0, 0};
+    for (uint64_t rest = board.aliveUnits(); rest != 0; rest &= rest - 1) {
+        const CUnitData& unit = board.unit(__builtin_ctzll(rest));
+        score[unit.fraction] += materialWeight * std::max(int(unit.health), 0) *
+                                unitStats[unit.fraction][unit.type].damage;
+        score[unit.fraction] += mobilityWeight * __builtin_popcountll(
+                reachTable.move[unit.fraction][unit.type][unit.square] & board.playable() & ~board.occupied());
+    }
+    uint64_t defendingLeader = board.fractionMask(defending) & board.typeMask(leader);
+    if (board.leaderInDanger()) {
+        int cur = __builtin_ctzll(defendingLeader);
+        score[attacking] += leaderThreatWeight * board.threatCount(attacking, cur / boardSize, cur % boardSize);
+    }
+    int total = score[attacking] - score[defending];
+    return player == attacking ? total : -total;
+}
+
+bool playMatch(CGameState& state, CPlayer& attackingPlayer, CPlayer& defendingPlayer, int maxActions) {
+    for (int i = 0; i < maxActions && !isTerminal(state); ++i) {
+        CPlayer& player = (state.toMove() == attacking ? attackingPlayer : defendingPlayer);
+        if (!applyAction(state, player.chooseAction(state))) {
+            return false;
+        }
+    }
+    return isTerminal(state);
+}
+
+CRandomPlayer::CRandomPlayer(uint64_t seed): seed_(seed) {}
+
+CAction CRandomPlayer::chooseAction(const CGameState& state) {
+    if (state.phase() == editCompositePhase) {
+        return CAction(endEditAction);
+    }
+    legalActions(state, actions_);
+    return actions_[splitMix64(seed_) % actions_.size()];
+}
+
+CAction CGreedyPlayer::chooseAction(const CGameState& state) {
+    if (state.phase() == editCompositePhase) {
+        return CAction(endEditAction);
+    }
+    legalActions(state, actions_);
+    CGameState copy = state;
+    size_t best = 0;
+    int bestScore = -winScore - 1;
+    for (size_t i = 0; i < actions_.size(); ++i) {
+        makeAction(copy, actions_[i], stack_);
+        int score = (isTerminal(copy) ? (copy.winner() == state.toMove() ? winScore : -winScore) :
+                     evaluate(copy, state.toMove()));
+        unmakeAction(copy, stack_);
+        if (score > bestScore) {
+            bestScore = score;
+            best = i;
+        }
+    }
+    return actions_[best];
+}
+
+thread_local CWorkStealingPool* currentPool = nullptr;
+thread_local int currentWorker = -1;
+
+CWorkStealingPool::CWorkStealingPool(int threads): queued_(0), pending_(0), next_(0), stolen_(0), done_(false) {
+    for (int i = 0; i < std::max(1, threads); ++i) {
+        queues_.emplace_back(new CQueue());
+    }
+    for (int i = 0; i < std::max(1, threads); ++i) {
+        workers_.emplace_back(&CWorkStealingPool::work, this, i);
+    }
+}
+
+CWorkStealingPool::~CWorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        done_ = true;
+    }
+    idle_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i].join();
+    }
+}
+
+int CWorkStealingPool::threads() const {
+    return workers_.size();
+}
+
+size_t CWorkStealingPool::stolen() const {
+    return stolen_;
+}
+
+void CWorkStealingPool::submit(std::function<void()> task) {
+    size_t queue = (currentPool == this ? currentWorker : next_++ % queues_.size());
+    ++pending_;
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+        ++queued_; // before the push, a worker can take the task as soon as the lock is released
+        queues_[queue]->tasks.push_back(std::move(task));
+    }
+    std::lock_guard<std::mutex> lock(idleMutex_); // a worker checks queued_ under this lock before it sleeps
+    idle_.notify_one();
+}
+
+void CWorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(idleMutex_);
+    finished_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+bool CWorkStealingPool::takeTask(int worker, std::function<void()>& task) {
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        CQueue& queue = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) { // the newest own task is the one most likely still in cache
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            ++stolen_;
+        }
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+void CWorkStealingPool::work(int worker) {
+    currentPool = this;
+    currentWorker = worker;
+    while (true) {
+        std::function<void()> task;
+        if (takeTask(worker, task)) {
+            task();
+            std::lock_guard<std::mutex> lock(idleMutex_);
+            if (--pending_ == 0) {
+                finished_.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idle_.wait(lock, [this]() { return queued_ > 0 || done_; });
+        if (done_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+CMctsTree::CMctsTree(size_t capacity, uint64_t seed, int maxPlayout): pool_(capacity), used_(0), seed_(seed),
+        maxPlayout_(maxPlayout) {}
+
+const CMctsNode& CMctsTree::node(int node) const {
+    return pool_[node];
+}
+
+size_t CMctsTree::used() const {
+    return used_;
+}
+
+void CMctsTree::searchActions(const CGameState& state) {
+    if (state.phase() == editCompositePhase) { // as the alpha-beta player, keep the built composite
+        actions_.assign(1, CAction(endEditAction));
+        return;
+    }
+    legalActions(state, actions_);
+}
+
+int CMctsTree::selectChild(int parent, double exploration) const {
+    const CMctsNode& node = pool_[parent];
+    double logVisits = std::log(double(node.visits));
+    int best = node.firstChild;
+    double bestValue = -1;
+    for (int child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+        if (pool_[child].visits == 0) {
+            return child;
+        }
+        double value = pool_[child].wins / pool_[child].visits +
+                       exploration * std::sqrt(logVisits / pool_[child].visits);
+        if (value > bestValue) {
+            bestValue = value;
+            best = child;
+        }
+    }
+    return best;
+}
+
+bool CMctsTree::expand(int parent, const CGameState& state) {
+    searchActions(state);
+    if (used_ + actions_.size() > pool_.size()) {
+        return false;
+    }
+    pool_[parent].firstChild = used_;
+    pool_[parent].childCount = actions_.size();
+    for (size_t i = 0; i < actions_.size(); ++i) {
+        CMctsNode& child = pool_[used_++];
+        child.action = actions_[i];
+        child.mover = state.toMove();
+        child.parent = parent;
+        child.childCount = -1;
+        child.visits = 0;
+        child.wins = 0;
+    }
+    return true;
+}
+
+double CMctsTree::playout(CGameState& state) {
+    size_t base = stack_.size();
+    for (int i = 0; i < maxPlayout_ && !isTerminal(state); ++i) {
+        searchActions(state);
+        makeAction(state, actions_[splitMix64(seed_) % actions_.size()], stack_);
+    }
+    double result;
+    if (isTerminal(state)) {
+        result = (state.winner() == attacking ? 1 : 0);
+    } else { // cut off, the evaluation tells who is ahead
+        int score = evaluate(state, attacking);
+        result = (score > 0 ? 1 : score < 0 ? 0 : 0.5);
+    }
+    while (stack_.size() > base) {
+        unmakeAction(state, stack_);
+    }
+    return result;
+}
+
+void CMctsTree::search(const CGameState& root, int iterations, double exploration) {
+    CGameState state = root;
+    used_ = 1;
+    pool_[0].parent = -1;
+    pool_[0].childCount = -1;
+    pool_[0].visits = 0;
+    pool_[0].wins = 0;
+    stack_.clear();
+    for (int i = 0; i < iterations; ++i) {
+        int node = 0;
+        while (pool_[node].childCount > 0) {
+            node = selectChild(node, exploration);
+            makeAction(state, pool_[node].action, stack_);
+        }
+        // leaves are expanded on their second visit, the root right away
+        if (!isTerminal(state) && (node == 0 || pool_[node].visits > 0) && expand(node, state)) {
+            node = pool_[node].firstChild;
+            makeAction(state, pool_[node].action, stack_);
+        }
+        double result = playout(state);
+        for (int cur = node; cur != -1; cur = pool_[cur].parent) {
+            pool_[cur].visits++;
+            pool_[cur].wins += (cur == 0 || pool_[cur].mover == attacking ? result : 1 - result);
+        }
+        while (stack_.size() > 0) {
+            unmakeAction(state, stack_);
+        }
+    }
+}
+
+CMctsPlayer::CMctsPlayer(int iterations, int threads, size_t capacity, int maxPlayout, double exploration):
+        iterations_(iterations), exploration_(exploration) {
+    for (int i = 0; i < std::max(threads, 1); ++i) {
+        trees_.emplace_back(capacity, 0x2545f4914f6cdd1dULL * (i + 1), maxPlayout);
+    }
+}
+
+const CMctsTree& CMctsPlayer::tree(int thread) const {
+    return trees_[thread];
+}
+
+int CMctsPlayer::threads() const {
+    return trees_.size();
+}
+
+CAction CMctsPlayer::chooseAction(const CGameState& state) {
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < trees_.size(); ++i) {
+        workers.emplace_back(&CMctsTree::search, &trees_[i], std::cref(state), iterations_, exploration_);
+    }
+    trees_[0].search(state, iterations_, exploration_);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+    // every tree expands the root into the same actions, the most visited one over all trees is played
+    const CMctsNode& root = trees_[0].node(0);
+    if (root.childCount <= 0) { // the pool could not hold even the root's children
+        return legalActions(state)[0];
+    }
+    int best = 0, bestVisits = -1;
+    for (int child = 0; child < root.childCount; ++child) {
+        int visits = 0;
+        for (size_t i = 0; i < trees_.size(); ++i) {
+            visits += trees_[i].node(trees_[i].node(0).firstChild + child).visits;
+        }
+        if (visits > bestVisits) {
+            bestVisits = visits;
+            best = child;
+        }
+    }
+    return trees_[0].node(root.firstChild + best).action;
+}
+
+CTranspositionTable::CTranspositionTable(size_t entries): entries_(bucketSize) {
+    size_t size = bucketSize;
+    while (size < entries) {
+        size *= 2;
+    }
+    std::vector<CEntry>(size).swap(entries_);
+    bucketMask_ = size / bucketSize - 1;
+    clear();
+}
+
+size_t CTranspositionTable::size() const {
+    return entries_.size();
+}
+
+void CTranspositionTable::clear() {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        entries_[i].check.store(0, std::memory_order_relaxed);
+        entries_[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t CTranspositionTable::pack(int depth, boundType bound, int score, int action) {
+    return uint64_t(uint32_t(score)) | uint64_t(uint8_t(depth)) << 32 | uint64_t(uint8_t(bound)) << 40 |
+           uint64_t(1) << 47 | uint64_t(uint16_t(action)) << 48; // bit 47 keeps stored data nonzero
+}
+
+bool CTranspositionTable::probe(uint64_t hash, CTableHit& hit) const {
+    const CEntry* bucket = &entries_[(hash & bucketMask_) * bucketSize];
+    for (int i = 0; i < bucketSize; ++i) {
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        if ((bucket[i].check.load(std::memory_order_relaxed) ^ data) == hash && data != 0) {
+            hit.score = int32_t(uint32_t(data));
+            hit.depth = uint8_t(data >> 32);
+            hit.bound = boundType(uint8_t(data >> 40) & 3);
+            hit.action = int16_t(uint16_t(data >> 48));
+            return true;
+        }
+    }
+    return false;
+}
+
+void CTranspositionTable::store(uint64_t hash, int depth, boundType bound, int score, int action) {
+    CEntry* bucket = &entries_[(hash & bucketMask_) * bucketSize];
+    CEntry* victim = bucket;
+    int victimDepth = 256;
+    for (int i = 0; i < bucketSize; ++i) { // the same position, else the shallowest entry is replaced
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        if ((bucket[i].check.load(std::memory_order_relaxed) ^ data) == hash) {
+            victim = &bucket[i];
+            break;
+        }
+        int entryDepth = (data == 0 ? -1 : uint8_t(data >> 32));
+        if (entryDepth < victimDepth) {
+            victimDepth = entryDepth;
+            victim = &bucket[i];
+        }
+    }
+    uint64_t data = pack(depth, bound, score, action);
+    victim->check.store(hash ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
+
+CAlphaBetaPlayer::CAlphaBetaPlayer(int depth, size_t nodeBudget, CTranspositionTable* table): depth_(depth),
+        nodeBudget_(nodeBudget), nodes_(0), lastScore_(0), player_(attacking), table_(table),
+        stop_(nullptr), timeBudget_(0), timeUp_(false), completed_(false), lastDepth_(0), lastSeconds_(0), longestSeconds_(0),
+        totalSeconds_(0), moves_(0), actions_(depth + 1) {}
+
+size_t CAlphaBetaPlayer::nodes() const {
+    return nodes_;
+}
+
+int CAlphaBetaPlayer::lastScore() const {
+    return lastScore_;
+}
+
+void CAlphaBetaPlayer::searchActions(const CGameState& state, std::vector<CAction>& actions) {
+    if (state.phase() == editCompositePhase) { // the built composite already lets every soldier move alone
+        actions.assign(1, CAction(endEditAction));
+        return;
+    }
+    legalActions(state, actions);
+}
+
+// the table keeps scores for the attacking fraction and win distances counted from the stored node
+int scoreToTable(int score, int ply, fraction player) {
+    score = (score > winScore - 1000 ? score + ply : score < 1000 - winScore ? score - ply : score);
+    return player == attacking ? score : -score;
+}
+
+int scoreFromTable(int score, int ply, fraction player) {
+    score = (player == attacking ? score : -score);
+    return score > winScore - 1000 ? score - ply : score < 1000 - winScore ? score + ply : score;
+}
+
+boundType boundForPlayer(boundType bound, fraction player) { // the same flip both ways
+    if (player == attacking || bound == exactBound) {
+        return bound;
+    }
+    return bound == lowerBound ? upperBound : lowerBound;
+}
+
+int tableOrder(size_t i, int tableAction) { // legalActions index of the i-th searched action
+    if (tableAction <= 0) {
+        return i;
+    }
+    return i == 0 ? tableAction : int(i) == tableAction ? 0 : i;
+}
+
+int CAlphaBetaPlayer::search(CGameState& state, int depth, int alpha, int beta, int ply) {
+    ++nodes_;
+    if (isTerminal(state)) {
+        return state.winner() == player_ ? winScore - ply : ply - winScore; // faster wins, slower losses
+    }
+    if (depth == 0 || stopped()) {
+        return evaluate(state, player_);
+    }
+    int alphaOrig = alpha, betaOrig = beta;
+    uint64_t hash = 0;
+    int tableAction = -1;
+    if (table_ != nullptr) {
+        hash = state.hash();
+        CTableHit hit;
+        if (table_->probe(hash, hit)) {
+            tableAction = hit.action;
+            if (hit.depth >= depth) {
+                int score = scoreFromTable(hit.score, ply, player_);
+                boundType bound = boundForPlayer(hit.bound, player_);
+                if (bound == exactBound) {
+                    return score;
+                } else if (bound == lowerBound) {
+                    alpha = std::max(alpha, score);
+                } else {
+                    beta = std::min(beta, score);
+                }
+                if (alpha >= beta) {
+                    return score;
+                }
+            }
+        }
+    }
+    std::vector<CAction>& actions = actions_[ply];
+    searchActions(state, actions);
+    if (tableAction >= int(actions.size())) {
+        tableAction = -1;
+    }
+    if (tableAction > 0) {
+        std::swap(actions[0], actions[tableAction]);
+    }
+    bool maximizing = (state.toMove() == player_);
+    int best = (maximizing ? -winScore - 1 : winScore + 1);
+    int bestAction = -1;
+    for (size_t i = 0; i < actions.size() && alpha < beta; ++i) {
+        makeAction(state, actions[i], stack_);
+        int score = search(state, depth - 1, alpha, beta, ply + 1);
+        unmakeAction(state, stack_);
+        if (maximizing ? score > best : score < best) {
+            best = score;
+            bestAction = tableOrder(i, tableAction);
+        }
+        if (maximizing) {
+            alpha = std::max(alpha, best);
+        } else {
+            beta = std::min(beta, best);
+        }
+        if (aborted()) { // the result is thrown away, the siblings need not be searched
+            break;
+        }
+    }
+    if (table_ != nullptr && !stopped()) { // cut off searches are not stored
+        boundType bound = (best <= alphaOrig ? upperBound : best >= betaOrig ? lowerBound : exactBound);
+        table_->store(hash, depth, boundForPlayer(bound, player_), scoreToTable(best, ply, player_), bestAction);
+    }
+    return best;
+}
+
+CAction CAlphaBetaPlayer::searchRoot(CGameState& root, int depth) {
+    std::vector<CAction>& actions = actions_[0];
+    searchActions(root, actions);
+    CTableHit hit;
+    int tableAction = (table_ != nullptr && table_->probe(root.hash(), hit) ? hit.action : -1);
+    if (tableAction >= int(actions.size())) {
+        tableAction = -1;
+    }
+    if (tableAction > 0) {
+        std::swap(actions[0], actions[tableAction]);
+    }
+    CAction best = actions[0];
+    int bestAction = tableOrder(0, tableAction);
+    lastScore_ = -winScore - 1;
+    completed_ = true;
+    for (size_t i = 0; i < actions.size(); ++i) {
+        makeAction(root, actions[i], stack_);
+        int score = search(root, depth - 1, lastScore_, winScore + 1, 1);
+        unmakeAction(root, stack_);
+        if (score > lastScore_) {
+            lastScore_ = score;
+            best = actions[i];
+            bestAction = tableOrder(i, tableAction);
+        }
+        if (interrupted()) { // the clock is not read again, a subtree which finished in time counts
+            completed_ = false;
+            break;
+        }
+    }
+    if (table_ != nullptr && completed_ && (nodeBudget_ == 0 || nodes_ < nodeBudget_)) {
+        table_->store(root.hash(), depth, exactBound, scoreToTable(lastScore_, 0, player_), bestAction);
+    }
+    return best;
+}
+
+CAction CAlphaBetaPlayer::chooseAction(const CGameState& state) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    deadline_ = start + std::chrono::milliseconds(timeBudget_);
+    timeUp_ = false;
+    nodes_ = 0;
+    player_ = state.toMove();
+    CGameState root = state;
+    // placements are judged one at a time, searching them deeper multiplies the branching for little gain
+    int depth = (root.phase() == placementPhase ? 1 : depth_);
+    lastDepth_ = (timeBudget_ > 0 ? 1 : depth);
+    CAction best = searchRoot(root, lastDepth_); // a depth of one only evaluates, it is never cut short
+    int score = lastScore_;
+    // with a time budget the depth grows until the clock runs out, the unfinished iteration is thrown away
+    while (timeBudget_ > 0 && lastDepth_ < depth && std::abs(score) < winScore - 1000) {
+        CAction action = searchRoot(root, lastDepth_ + 1);
+        if (!completed_) {
+            break;
+        }
+        best = action;
+        score = lastScore_;
+        ++lastDepth_;
+    }
+    lastScore_ = score;
+    lastSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    longestSeconds_ = std::max(longestSeconds_, lastSeconds_);
+    totalSeconds_ += lastSeconds_;
+    ++moves_;
+    return best;
+}
+
+void CAlphaBetaPlayer::setTimeBudget(int milliseconds) {
+    timeBudget_ = std::max(0, milliseconds);
+}
+
+bool CAlphaBetaPlayer::stopped() {
+    return aborted() || (nodeBudget_ != 0 && nodes_ >= nodeBudget_);
+}
+
+bool CAlphaBetaPlayer::aborted() {
+    if (timeBudget_ > 0 && !timeUp_ && nodes_ % 256 == 0) { // reading the clock costs more than a node
+        timeUp_ = std::chrono::steady_clock::now() >= deadline_;
+    }
+    return interrupted();
+}
+
+bool CAlphaBetaPlayer::interrupted() const {
+    return timeUp_ || (stop_ != nullptr && stop_->load(std::memory_order_relaxed));
+}
+
+int CAlphaBetaPlayer::lastDepth() const {
+    return lastDepth_;
+}
+
+double CAlphaBetaPlayer::lastSeconds() const {
+    return lastSeconds_;
+}
+
+double CAlphaBetaPlayer::longestSeconds() const {
+    return longestSeconds_;
+}
+
+double CAlphaBetaPlayer::totalSeconds() const {
+    return totalSeconds_;
+}
+
+int CAlphaBetaPlayer::moves() const {
+    return moves_;
+}
+
+CLazySmpPlayer::CLazySmpPlayer(int depth, int threads, CTranspositionTable* table, size_t tableEntries):
+        table_(table), seconds_(std::max(1, threads), 0.0), stop_(false) {
+    if (table_ == nullptr) {
+        ownTable_.reset(new CTranspositionTable(tableEntries));
+        table_ = ownTable_.get();
+    }
+    // half of the helpers look one action deeper, their entries let the others cut earlier
+    for (int i = 0; i < std::max(1, threads); ++i) {
+        searchers_.emplace_back(depth + i % 2, 0, table_);
+        searchers_.back().stop_ = &stop_;
+    }
+}
+
+void CLazySmpPlayer::runSearcher(const CGameState& state, int i) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    searchers_[i].chooseAction(state);
+    seconds_[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CAction CLazySmpPlayer::chooseAction(const CGameState& state) {
+    stop_.store(false);
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < searchers_.size(); ++i) {
+        helpers.emplace_back(&CLazySmpPlayer::runSearcher, this, std::cref(state), int(i));
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CAction best = searchers_[0].chooseAction(state); // the main searcher answers, helpers only fill the table
+    seconds_[0] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stop_.store(true);
+    for (size_t i = 0; i < helpers.size(); ++i) {
+        helpers[i].join();
+    }
+    return best;
+}
+
+int CLazySmpPlayer::threads() const {
+    return searchers_.size();
+}
+
+size_t CLazySmpPlayer::nodes(int thread) const {
+    return searchers_[thread].nodes();
+}
+
+size_t CLazySmpPlayer::totalNodes() const {
+    size_t total = 0;
+    for (size_t i = 0; i < searchers_.size(); ++i) {
+        total += searchers_[i].nodes();
+    }
+    return total;
+}
+
+double CLazySmpPlayer::seconds(int thread) const {
+    return seconds_[thread];
+}
+
+double CLazySmpPlayer::nodesPerSecond(int thread) const {
+    return seconds_[thread] > 0 ? searchers_[thread].nodes() / seconds_[thread] : 0.0;
+}
+
+int CLazySmpPlayer::lastScore() const {
+    return searchers_[0].lastScore();
+}
+
+std::vector<CGameState> searchSuite(size_t count, uint64_t seed) {
+    std::vector<CGameState> suite;
+    std::vector<CAction> actions;
+    while (suite.size() < count) {
+        CGameState state;
+        int moves = splitMix64(seed) % 24; // random actions played after the armies are set up
+        while (!isTerminal(state) && (state.phase() < movePhase || moves-- > 0)) {
+            legalActions(state, actions);
+            applyAction(state, state.phase() == editCompositePhase ? CAction(endEditAction) :
+                        actions[splitMix64(seed) % actions.size()]);
+        }
+        if (!isTerminal(state)) {
+            suite.push_back(state);
+        }
+    }
+    return suite;
+}
+
+CGame::CGame(const CGameState& state): state_(state), players_{nullptr, nullptr} {
+    std::cout << "Welcome to the game." << '\n' << '\n';
+    state_.board().printBoard();
+}
+
+void CGame::addObserver(CPhaseObserver* observer) {
+    observers_.push_back(observer);
+}
+
+void CGame::setPlayer(fraction fraction, CPlayer* player) {
+    players_[fraction] = player;
+}
+
+const CGameState& CGame::state() const {
+    return state_;
+}
+
+bool CGame::play(const CAction& action) {
+    gamePhase phase = state_.phase();
+    fraction side = state_.toMove();
+    if (!applyAction(state_, action)) {
+        return false;
+    }
+    if (state_.phase() != phase || state_.toMove() != side) {
+        for (size_t i = 0; i < observers_.size(); ++i) {
+            observers_[i]->onPhaseChange(phase, side, state_.phase(), state_.toMove());
+        }
+    }
+    return true;
+}
+
+std::pair<int, int> CGame::tryPlaceUnit() const {
+    int x, y;
+    std::cin >> x >> y;
+    while (!state_.board().canPlaceUnit(x - 1, y - 1)) {
+        std::cout << "This coordinates are unavailable, try again!" << '\n';
+        std::cin >> x >> y;
+    }
+    return std::make_pair(x, y);
+}
+
+void CGame::placeLeader(fraction fraction) {
+    std::cout << (fraction == attacking ? "Attacking" : "Defending")  << " player, please enter the coordinates of the "
+                                                                         "position of your leader, separated by whitespace, "
+                                                                         "correct coordinates are between 1 and "
+                                                                      << state_.board().side() << "." << '\n';
+    std::pair<int, int> correctPosition = tryPlaceUnit();
+    int x = correctPosition.first, y = correctPosition.second;
+    play(CAction(placeAction, x - 1, y - 1, 0, 0, leader));
+    state_.board().printBoard();
+}
+
+void CGame::placeUnit(fraction fraction) {
+    std::cout << "You can place infantry or shooter: enter 1 to place infantry and 2 to place shooter." << '\n';
+    int warriorType;
+    std::cin >> warriorType;
+    while (warriorType != 1 and warriorType != 2) {
         std::cout << "This type is unavailable, try again." << '\n';
         std::cin >> warriorType;
     }
     std::cout << (fraction == attacking ? "Attacking" : "Defending")  << " player, please enter the coordinates of the "
                                                                          "position you want to place the unit, separated "
                                                                          "by whitespace, correct coordinates are between 1 "
-                                                                         "and " << boardSize << "." << '\n';
+                                                                         "and " << state_.board().side() << "." << '\n';
     std::cout << "The first coordinate is vertical, the second - horizontal." << '\n';
     std::pair<int, int> correct_position = tryPlaceUnit();
     int x = correct_position.first, y = correct_position.second;
-    if (fraction == attacking) {
-        if (warriorType == 1) {
-            CUnit* warrior = attackingFactory->createInfantry();
-            CPlayingBoard::placeUnit(x - 1, y - 1, warrior);
-        } else {
-            CUnit* warrior = attackingFactory->createShooter();
-            CPlayingBoard::placeUnit(x - 1, y - 1, warrior);
-        }
-    } else {
-        if (warriorType == 1) {
-            CUnit* warrior = defendingFactory->createInfantry();
-            CPlayingBoard::placeUnit(x - 1, y - 1, warrior);
-        } else {
-            CUnit* warrior = defendingFactory->createShooter();
-            CPlayingBoard::placeUnit(x - 1, y - 1, warrior);
-        }
-    }
-    CPlayingBoard::printBoard();
-    placeUnit(fraction, unitsLeft - 1);
-}
-
-void CGame::placeArmy() {
-    placeLeader(attacking);
+    play(CAction(placeAction, x - 1, y - 1, 0, 0, warriorType == 1 ? infantry : shooter));
+    state_.board().printBoard();
 }
 
 void CGame::makeMove(fraction fraction) {
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
+    const CComposite& composite = state_.composite(fraction);
     std::cout << (fraction == attacking ? "Attacking " : "Defending ") << "player move." << '\n' << '\n';
-    CPlayingBoard::printBoard();
+    state_.board().printBoard();
     std::cout << "Your army composite." << '\n';
     composite.printComposite();
     std::cout << '\n';
@@ -686,7 +3054,8 @@ void CGame::makeMove(fraction fraction) {
                  "should be -1 and the second is the number of the structure." << '\n';
     int x, y;
     std::cin >> x >> y;
-    while (!(composite.getNode(x, y) != nullptr && CPlayingBoard::allUnmovedComposite(composite.getNode(x, y)))) {
+    while (!(composite.getNode(x, y) != -1 && CBitBoard::nodeMask(composite, composite.getNode(x, y)) != 0 &&
+             CPlayingBoard::allUnmovedComposite(composite, composite.getNode(x, y)))) {
         std::cout << "This coordinates are unavailable, try again!" << '\n';
         std::cin >> x >> y;
     }
@@ -695,114 +3064,29 @@ void CGame::makeMove(fraction fraction) {
                  "The first coordinate is vertical offset, the second - horizontal." << '\n';
 
     std::cin >> offsetX >> offsetY;
-    while (!CPlayingBoard::canMoveComposite(composite, std::make_pair(x, y), offsetX, offsetY)) {
+    while (!play(CAction(moveAction, x, y, offsetX, offsetY))) {
         std::cout << "The offset is incorrect." << '\n';
         std::cin >> offsetX >> offsetY;
     }
-    CPlayingBoard::moveComposite(x, y, offsetX, offsetY, composite);
-}
-
-void CGame::makeMovePhase(fraction fraction) {
-    if (gameFinished) {
-        return;
-    }
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
-    while (!CPlayingBoard::allMovedComposite(composite.getTopNode(), 0)) {
-        makeMove(fraction);
-    }
-    if (fraction == attacking) {
-        composite.startNewMove();
-        makeMovePhase(defending);
-    } else {
-        composite.startNewMove();
-        makeAttackPhase(attacking);
-    }
-}
-
-bool CPlayingBoard::canAttack(int x, int y) {
-    for (size_t i = 0; i < desk_->size(); ++i) {
-        for (size_t l = 0; l < desk_->at(i).size(); ++l) {
-            if (CPlayingBoard::canAttack(x, y, i, l)) {
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
-size_t CComposite::size() const {
-    size_t size = 0;
-    std::queue<std::shared_ptr<CNode> > q;
-    q.push(topNode_);std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
-    while (!q.empty()) {
-        std::shared_ptr<CNode> curPtr = q.front();
-        q.pop();
-        if (curPtr->getSavedComponent().first == -1) {
-            for (size_t i = 0; i < curPtr->children_.size(); ++i) {
-                q.push(curPtr->children_[i]);
-            }
-        } else {
-            size++;
-        }
-    }
-    return size;
-}
-
-void CGame::makeAttack(fraction fraction) {
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
-    CComposite enemyComposite = (fraction == attacking ? defendingComposite : attackingComposite);
-    for (size_t i = 0; i < CPlayingBoard::desk_->size() && !gameFinished; ++i) {
-        for (size_t l = 0; l < CPlayingBoard::desk_->at(i).size() && !gameFinished; ++l) {
-            if (CPlayingBoard::canAttack(i, l) && CPlayingBoard::desk_->at(i)[l]->getFraction() == fraction) {
-                CPlayingBoard::printBoard();
-                std::cout << "Current attacking unit's position " << i + 1 << " " << l + 1 << "." << '\n';
-                std::cout << "Write the coordinates of unit you want to attack, the coordinates must be separated with "
-                             "the whitespace. Coordinates must be between 1 and " << boardSize << "." << '\n';
-                std::cout << "The first coordinate is horizontal, the second - vertical." << '\n';
-                int x, y;
-                std::cin >> x >> y;
-                while (!CPlayingBoard::canAttack(i, l, x - 1, y - 1)) {
-                    std::cout << "This coordinates are unavailable, maybe unit can't reach the target, try again!" << '\n';
-                    std::cin >> x >> y;
-                }
-                CPlayingBoard::attack(i, l, x - 1, y - 1);
-                if (CPlayingBoard::desk_->at(x - 1)[y - 1]->getHealth() <= 0) {
-                    if (CPlayingBoard::desk_->at(x - 1)[y - 1]->getWarriorType() == leader &&
-                    CPlayingBoard::desk_->at(x - 1)[y - 1]->getFraction() == defending) {
-                        gameFinished = true;
-                        winner = fraction;
-                    }
-                    delete CPlayingBoard::desk_->at(x - 1)[y - 1];
-                    CPlayingBoard::desk_->at(x - 1)[y - 1] = nullptr;
-                    std::shared_ptr<CNode> parent = enemyComposite.getParentNode(x - 1, y - 1);
-                    parent->removeChild(x - 1, y - 1);
-                    if (enemyComposite.size() == 0) {
-                        gameFinished = true;
-                        winner = fraction;
-                    }
-                }
-            }
-        }
-    }
 }
 
-void CGame::makeAttackPhase(fraction fraction) {
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
-    makeAttack(fraction);
-    if (gameFinished) {
-        return;
-    }
-    if (fraction == attacking) {
-        composite.startNewMove();
-        makeAttackPhase(defending);
-    } else {
-        composite.startNewMove();
-        makeEditCompositePhase(attacking);
+void CGame::makeAttack() {
+    std::pair<int, int> unit = state_.attacker();
+    state_.board().printBoard();
+    std::cout << "Current attacking unit's position " << unit.first + 1 << " " << unit.second + 1 << "." << '\n';
+    std::cout << "Write the coordinates of unit you want to attack, the coordinates must be separated with "
+                 "the whitespace. Coordinates must be between 1 and " << state_.board().side() << "." << '\n';
+    std::cout << "The first coordinate is horizontal, the second - vertical." << '\n';
+    int x, y;
+    std::cin >> x >> y;
+    while (!play(CAction(attackAction, unit.first, unit.second, x - 1, y - 1))) {
+        std::cout << "This coordinates are unavailable, maybe unit can't reach the target, try again!" << '\n';
+        std::cin >> x >> y;
     }
 }
 
 void CGame::makeEditComposite(fraction fraction) {
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
+    const CComposite& composite = state_.composite(fraction);
     std::cout << (fraction == attacking ? "Attacking " : "Defending ") << "player can change composite." << '\n';
     std::cout << '\n' << "Composite" << '\n';
     composite.printComposite();
@@ -813,22 +3097,22 @@ void CGame::makeEditComposite(fraction fraction) {
     std::cin >> state;
     while (state != 1 && state != 2 && state != 3) {
         std::cout << "Incorrect command entered." << '\n';
+        std::cin >> state;
     }
     while (state != 3) {
         if (state == 1) {
             std::cout << "Enter the number of the future parent structure." << '\n';
             int structureNumber;
             std::cin >> structureNumber;
-            while (composite.getNode(-1, structureNumber) == nullptr) {
+            while (!play(CAction(addStructureAction, 0, 0, 0, 0, structureNumber))) {
                 std::cout << "Incorrect number entered" << '\n';
                 std::cin >> structureNumber;
             }
-            composite.addChild(structureNumber);
         } else if (state == 2) {
             std::cout << "Enter the number of you structure." << '\n';
             int structureNumber;
             std::cin >> structureNumber;
-            while (composite.getNode(-1, structureNumber) == nullptr) {
+            while (composite.getNode(-1, structureNumber) == -1) {
                 std::cout << "Incorrect number entered" << '\n';
                 std::cin >> structureNumber;
             }
@@ -836,11 +3120,13 @@ void CGame::makeEditComposite(fraction fraction) {
                          "the whitespace." << '\n';
             int x, y;
             std::cin >> x >> y;
-            while (x == -1 || composite.getNode(x, y) == nullptr) {
+            while (x == -1 || composite.getNode(x, y) == -1) {
                 std::cout << "Incorrect data entered, try again!" << '\n';
                 std::cin >> x >> y;
             }
-            composite.switchChild(x, y, structureNumber);
+            if (!play(CAction(switchChildAction, x, y, 0, 0, structureNumber))) {
+                std::cout << "Soldiers can only join the lowest structures." << '\n';
+            }
         }
         composite.printComposite();
         std::cout << '\n';
@@ -849,27 +3135,328 @@ void CGame::makeEditComposite(fraction fraction) {
         std::cin >> state;
         while (state != 1 && state != 2 && state != 3) {
             std::cout << "Incorrect command entered." << '\n';
+            std::cin >> state;
+        }
+    }
+    play(CAction(endEditAction));
+}
+
+void CGame::makeBotAction(fraction fraction) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CAction action = players_[fraction]->chooseAction(state_);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (fraction == attacking ? "Attacking " : "Defending ") << "bot: ";
+    if (action.type == placeAction) {
+        std::cout << "places a unit at " << action.x + 1 << " " << action.y + 1 << "." << '\n';
+    } else if (action.type == moveAction) {
+        std::cout << "moves " << action.x << " " << action.y << " by " << action.targetX << " " << action.targetY
+                  << "." << '\n';
+    } else if (action.type == attackAction) {
+        std::cout << "attacks from " << action.x + 1 << " " << action.y + 1 << " to " << action.targetX + 1 << " "
+                  << action.targetY + 1 << "." << '\n';
+    } else if (action.type == passAction) {
+        std::cout << "passes." << '\n';
+    } else {
+        std::cout << "edits the composite." << '\n';
+    }
+    std::cout << "The bot thought for " << milliseconds << " ms." << '\n';
+    play(action);
+    if (action.type != addStructureAction && action.type != switchChildAction && action.type != endEditAction) {
+        state_.board().printBoard();
+    }
+}
+
+void CGame::game() {
+    while (!isTerminal(state_)) {
+        fraction side = state_.toMove();
+        if (players_[side] != nullptr) {
+            makeBotAction(side);
+        } else if (state_.phase() == placementPhase) {
+            if (state_.placedUnits() == 0) {
+                placeLeader(side);
+            } else {
+                placeUnit(side);
+            }
+        } else if (state_.phase() == editCompositePhase) {
+            makeEditComposite(side);
+        } else if (state_.phase() == movePhase) {
+            if (isLegalAction(state_, CAction(passAction))) {
+                std::cout << "None of the unmoved units can move, the turn passes." << '\n';
+                play(CAction(passAction));
+            } else {
+                makeMove(side);
+            }
+        } else if (state_.phase() == attackPhase) {
+            makeAttack();
         }
     }
+    std::cout << "Game over!" << '\n';
+    std::cout << (state_.winner() == attacking ? "Attacking " : "Defending ") << "team won!" << '\n';
+}
+
+CBattle::CBattle(const CGameConfig& config, uint64_t seed, bool batched): config_(config), board_(config.boardSide),
+        attackingComposite_(attacking, board_), defendingComposite_(defending, board_), finished_(false),
+        winner_(attacking), rounds_(0), batched_(batched), rosterAt_(board_.side(), -1) {
+    placeArmy(attacking, seed);
+    placeArmy(defending, seed);
+    int side = board_.side();
+    board_.forEachUnit([this, side](int x, int y, const CUnit* unit) {
+        rosterAt_.set(x, y, int(roster_.size()));
+        roster_.push_back(CUnitData{uint8_t(unit->getFraction()), uint8_t(unit->getWarriorType()),
+                                    int16_t(unit->getHealth()), int32_t(x * side + y)});
+    });
+    attackingComposite_ = CComposite(attacking, board_);
+    defendingComposite_ = CComposite(defending, board_);
+}
+
+CComposite& CBattle::composite(fraction fraction) {
+    return fraction == attacking ? attackingComposite_ : defendingComposite_;
+}
+
+void CBattle::placeArmy(fraction fraction, uint64_t& seed) { // the leader on the back row, the rest in the own half
+    int side = board_.side();
+    int firstRow = (fraction == attacking ? 0 : side / 2), rows = (fraction == attacking ? side / 2 : side - side / 2);
+    int backRow = (fraction == attacking ? 0 : side - 1);
+    CAttackingFactory attackingFactory;
+    CDefendingFactory defendingFactory;
+    const CArmyFactory& factory = (fraction == attacking ? static_cast<const CArmyFactory&>(attackingFactory) :
+                                   defendingFactory);
+    board_.placeUnit(backRow, int(splitMix64(seed) % side), factory.createLeader());
+    int placed = std::min(config_.units[fraction], rows * side - 1);
+    for (int i = 0; i < placed; ++i) {
+        int x, y;
+        do {
+            x = firstRow + int(splitMix64(seed) % rows);
+            y = int(splitMix64(seed) % side);
+        } while (!board_.canPlaceUnit(x, y));
+        board_.placeUnit(x, y, splitMix64(seed) % 2 == 0 ? factory.createInfantry() : factory.createShooter());
+    }
 }
 
-void CGame::makeEditCompositePhase(fraction fraction) {
-    CComposite composite = (fraction == attacking ? attackingComposite : defendingComposite);
-    makeEditComposite(fraction);
-    if (gameFinished) {
+void CBattle::moveArmy(fraction fraction) {
+    CComposite& own = composite(fraction);
+    const CComposite& enemy = composite(fraction == attacking ? defending : attacking);
+    std::pair<int, int> goal(-1, -1);
+    int top = enemy.getTopNode();
+    for (int cur = top; cur != -1; cur = enemy.nextInSubtree(top, cur)) {
+        std::pair<int, int> soldier = enemy.node(cur).getSavedComponent();
+        if (soldier.first != -1 &&
+            (goal.first == -1 || board_.unitAt(soldier.first, soldier.second)->getWarriorType() == leader)) {
+            goal = soldier;
+        }
+    }
+    if (goal.first == -1) {
         return;
     }
-    if (fraction == attacking) {
-        composite.startNewMove();
-        makeEditCompositePhase(defending);
+    std::vector<std::pair<int, int> > soldiers;
+    top = own.getTopNode();
+    for (int cur = top; cur != -1; cur = own.nextInSubtree(top, cur)) {
+        if (own.node(cur).getSavedComponent().first != -1) {
+            soldiers.push_back(own.node(cur).getSavedComponent());
+        }
+    }
+    for (size_t i = 0; i < soldiers.size(); ++i) {
+        int x = soldiers[i].first, y = soldiers[i].second;
+        std::pair<int, int> target;
+        if (findTarget(x, y, target)) {
+            continue; // already in reach of an enemy, stay
+        }
+        const CUnit* unit = board_.unitAt(x, y);
+        CReach reach = unitStats[unit->getFraction()][unit->getWarriorType()].move;
+        int bestDistance = std::abs(goal.first - x) + std::abs(goal.second - y), bestX = 0, bestY = 0;
+        for (int xOffset = -reach.maxDistance; xOffset <= reach.maxDistance; ++xOffset) {
+            for (int yOffset = std::abs(xOffset) - reach.maxDistance; yOffset <= reach.maxDistance - std::abs(xOffset);
+                 ++yOffset) {
+                int distance = std::abs(goal.first - x - xOffset) + std::abs(goal.second - y - yOffset);
+                if (distance < bestDistance && board_.canMove(x, y, x + xOffset, y + yOffset)) {
+                    bestDistance = distance;
+                    bestX = xOffset;
+                    bestY = yOffset;
+                }
+            }
+        }
+        if (bestX != 0 || bestY != 0) {
+            board_.moveComposite(x, y, bestX, bestY, own);
+            if (board_.unitAt(x, y) == nullptr) {
+                int index = rosterAt_.get(x, y);
+                rosterAt_.set(x, y, -1);
+                rosterAt_.set(x + bestX, y + bestY, index);
+                roster_[index].square = (x + bestX) * board_.side() + y + bestY;
+            }
+        }
+    }
+    own.startNewMove();
+}
+
+bool CBattle::findTarget(int x, int y, std::pair<int, int>& target) const { // the enemy leader if it is in reach
+    const CUnit* unit = board_.unitAt(x, y);
+    std::vector<std::pair<int, int> > enemies;
+    board_.enemiesInRadius(x, y, unitStats[unit->getFraction()][unit->getWarriorType()].attack.maxDistance, enemies);
+    bool found = false;
+    for (size_t i = 0; i < enemies.size(); ++i) {
+        if (!board_.canAttack(x, y, enemies[i].first, enemies[i].second)) {
+            continue;
+        }
+        target = enemies[i];
+        found = true;
+        if (board_.unitAt(target.first, target.second)->getWarriorType() == leader) {
+            return true;
+        }
+    }
+    return found;
+}
+
+void CBattle::attackWithArmy(fraction fraction) {
+    planAttacks(fraction);
+    if (batched_) {
+        resolveBatched(fraction);
     } else {
-        composite.startNewMove();
-        makeMovePhase(attacking);
+        resolveSequentially(fraction);
     }
 }
 
-void CGame::game() {
-    makeEditCompositePhase(attacking);
-    std::cout << "Game over!" << '\n';
-    std::cout << (winner == attacking ? "Attacking " : "Defending ") << "team won!" << '\n';
-}
\ No newline at end of file
+void CBattle::planAttacks(fraction fraction) { // the targets are chosen before any of the attacks lands
+    attackers_.clear();
+    targets_.clear();
+    const CComposite& own = composite(fraction);
+    for (int cur = own.getTopNode(); cur != -1; cur = own.nextInSubtree(own.getTopNode(), cur)) {
+        std::pair<int, int> soldier = own.node(cur).getSavedComponent(), target;
+        if (soldier.first != -1 && findTarget(soldier.first, soldier.second, target)) {
+            attackers_.push_back(soldier);
+            targets_.push_back(target);
+        }
+    }
+}
+
+void CBattle::kill(int x, int y, fraction killer) {
+    const CUnit* victim = board_.unitAt(x, y);
+    if (victim->getWarriorType() == leader && victim->getFraction() == defending) {
+        finished_ = true;
+        winner_ = killer;
+    }
+    CComposite& enemy = composite(victim->getFraction());
+    rosterAt_.set(x, y, -1);
+    board_.removeUnit(x, y);
+    enemy.removeChild(x, y);
+    if (enemy.size() == 0) {
+        finished_ = true;
+        winner_ = killer;
+    }
+}
+
+void CBattle::resolveSequentially(fraction fraction) {
+    for (size_t i = 0; i < attackers_.size(); ++i) {
+        int target = rosterAt_.get(targets_[i].first, targets_[i].second);
+        if (target == -1) {
+            continue; // killed earlier in the plan
+        }
+        const CUnitData& attacker = roster_[rosterAt_.get(attackers_[i].first, attackers_[i].second)];
+        board_.attack(attackers_[i].first, attackers_[i].second, targets_[i].first, targets_[i].second);
+        roster_[target].health -= unitStats[attacker.fraction][attacker.type].damage;
+        if (roster_[target].health <= 0) {
+            kill(targets_[i].first, targets_[i].second, fraction);
+        }
+    }
+    sweep(fraction, false);
+}
+
+void scatterDamage(const int* damage, const int* targets, size_t count, int* lanes, size_t units) {
+    size_t i = 0;
+    for (; i + damageLanes <= count; i += damageLanes) { // a group has no conflicts, so it is one vector scatter
+        for (int lane = 0; lane < damageLanes; ++lane) {
+            lanes[lane * units + targets[i + lane]] += damage[i + lane];
+        }
+    }
+    for (int lane = 0; i < count; ++i, ++lane) {
+        lanes[lane * units + targets[i]] += damage[i];
+    }
+}
+
+void sumLanes(int* lanes, size_t units, int* loss) {
+    std::fill(loss, loss + units, 0);
+    for (int lane = 0; lane < damageLanes; ++lane) { // contiguous rows, the inner loop vectorises at -O3
+        int* row = lanes + lane * units;
+        for (size_t t = 0; t < units; ++t) {
+            loss[t] += row[t];
+            row[t] = 0;
+        }
+    }
+}
+
+void CBattle::sweep(fraction killer, bool batched) {
+    int side = board_.side();
+    size_t kept = 0;
+    for (size_t i = 0; i < roster_.size(); ++i) {
+        CUnitData unit = roster_[i];
+        int x = unit.square / side, y = unit.square % side;
+        if (unit.health <= 0) {
+            if (batched) {
+                kill(x, y, killer);
+            }
+            continue;
+        }
+        if (batched && loss_[i] != 0) {
+            board_.reduceHealth(x, y, loss_[i]);
+        }
+        if (kept != i) {
+            rosterAt_.set(x, y, int(kept));
+        }
+        roster_[kept++] = unit;
+    }
+    roster_.resize(kept);
+}
+
+void CBattle::resolveBatched(fraction fraction) {
+    // the attackers can not die while their fraction attacks, so only the sums of damage matter:
+    // a target dies in the batch exactly when it would die somewhere along the sequential order
+    damage_.clear();
+    targetSlots_.clear();
+    for (size_t i = 0; i < attackers_.size(); ++i) {
+        const CUnitData& attacker = roster_[rosterAt_.get(attackers_[i].first, attackers_[i].second)];
+        damage_.push_back(unitStats[attacker.fraction][attacker.type].damage);
+        targetSlots_.push_back(rosterAt_.get(targets_[i].first, targets_[i].second));
+    }
+    size_t units = roster_.size();
+    lanes_.resize(damageLanes * units); // zeroed by the last sumLanes, the roster only shrinks
+    loss_.resize(units);
+    scatterDamage(damage_.data(), targetSlots_.data(), targetSlots_.size(), lanes_.data(), units);
+    sumLanes(lanes_.data(), units, loss_.data());
+    for (size_t t = 0; t < units; ++t) {
+        roster_[t].health -= loss_[t];
+    }
+    sweep(fraction, true); // one pass over the roster passes the losses to the board and removes the dead
+}
+
+bool CBattle::playRound() {
+    if (finished_) {
+        return false;
+    }
+    moveArmy(attacking);
+    moveArmy(defending);
+    attackWithArmy(attacking);
+    if (!finished_) {
+        attackWithArmy(defending);
+    }
+    rounds_++;
+    return !finished_;
+}
+
+bool CBattle::finished() const {
+    return finished_;
+}
+
+fraction CBattle::winner() const {
+    return winner_;
+}
+
+int CBattle::rounds() const {
+    return rounds_;
+}
+
+const CPlayingBoard& CBattle::board() const {
+    return board_;
+}
+
+const CComposite& CBattle::army(fraction fraction) const {
+    return fraction == attacking ? attackingComposite_ : defendingComposite_;
+}
@@ -1,6 +1,8 @@
 #include "classes.cpp"
 #include <gtest/gtest.h>
 #include <utility>
+#include <tuple>
+#include <sstream>
 
 TEST(Correct_factory, defending_units) {
     CDefendingFactory defendingFactory = CDefendingFactory();
@@ -37,7 +39,8 @@ TEST(Correct_factory, decorator) {
 }
 
 TEST(Correct_board, creation) {
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    CPlayingBoard playingBoard;
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     ASSERT_TRUE(board->size() == boardSize);
     for (size_t i = 0; i < boardSize; ++i) {
         ASSERT_TRUE(board->at(i).size() == boardSize);
@@ -46,15 +49,16 @@ TEST(Correct_board, creation) {
         }
     }
     board.reset();
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_board, singleton) {
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    CPlayingBoard playingBoard;
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CAttackingFactory attackingFactory = CAttackingFactory();
     CUnit* leader = attackingFactory.createLeader();
-    board->at(0)[0] = leader;
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > newBoard = CPlayingBoard::board();
+    playingBoard.placeUnit(0, 0, leader);
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > newBoard = playingBoard.board();
     ASSERT_TRUE(board->size() == boardSize);
     for (size_t i = 0; i < boardSize; ++i) {
         ASSERT_TRUE(board->at(i).size() == boardSize);
@@ -62,15 +66,49 @@ TEST(Correct_board, singleton) {
             ASSERT_TRUE(board->at(i)[l] == newBoard->at(i)[l]);
         }
     }
+    ASSERT_TRUE(newBoard->at(0)[0] == leader && playingBoard.bitBoard().getWarriorType(0, 0) == warriorType::leader);
     board.reset();
     newBoard.reset();
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
+    CUnit* shooter = attackingFactory.createShooter();
+    ASSERT_THROW(playingBoard.placeUnit(1, 1, shooter), std::logic_error); // a deleted board is not remade silently
+    ASSERT_TRUE(playingBoard.unitAt(1, 1) == nullptr && playingBoard.board() != nullptr);
+    playingBoard.placeUnit(1, 1, shooter);
+    ASSERT_TRUE(playingBoard.unitAt(1, 1) == shooter && playingBoard.bitBoard().isOccupied(1, 1));
+    playingBoard.deleteBoard();
+    ASSERT_THROW(CPlayingBoard(0), std::invalid_argument);
+    ASSERT_THROW(CPlayingBoard(maxBoardSide + 1), std::invalid_argument);
+}
+
+TEST(Correct_board, separate_instances) {
+    CPlayingBoard first, second;
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    first.placeUnit(2, 3, attackingFactory.createLeader());
+    second.placeUnit(3, 2, defendingFactory.createShooter());
+    ASSERT_TRUE(first.board()->at(3)[2] == nullptr && second.board()->at(2)[3] == nullptr);
+    CComposite attackingComposite(attacking, first), defendingComposite(defending, second);
+    ASSERT_TRUE(attackingComposite.getNode(2, 3) != -1 && defendingComposite.getNode(3, 2) != -1);
+    second.moveComposite(3, 2, 1, 0, defendingComposite);
+    ASSERT_TRUE(second.bitBoard().isOccupied(4, 2) && !first.bitBoard().isOccupied(4, 2));
+
+    CPlayingBoard* threadBoard = nullptr;
+    std::thread other([&threadBoard]() {
+        threadBoard = &CPlayingBoard::current();
+    });
+    other.join();
+    ASSERT_TRUE(threadBoard != &CPlayingBoard::current()); // every thread starts with a board of its own
+    CPlayingBoard::setCurrent(&first);
+    ASSERT_TRUE(&CPlayingBoard::current() == &first);
+    CPlayingBoard::setCurrent(nullptr);
+    ASSERT_TRUE(&CPlayingBoard::current() != &first && CPlayingBoard::current().bitBoard().occupied() == 0);
 }
 
 TEST(Correct_board, place_unit) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     ASSERT_TRUE(board->size() == boardSize);
     for (size_t i = 0; i < boardSize; ++i) {
         ASSERT_TRUE(board->at(i).size() == boardSize);
@@ -80,8 +118,8 @@ TEST(Correct_board, place_unit) {
     }
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
     for (size_t i = 0; i < boardSize; ++i) {
         ASSERT_TRUE(board->at(i).size() == boardSize);
         for(size_t l = 0; l < boardSize; ++l) {
@@ -93,239 +131,258 @@ TEST(Correct_board, place_unit) {
         }
     }
     board.reset();
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_unit, canMove) {
+    CPlayingBoard playingBoard;
     CDefendingFactory defending = CDefendingFactory();
     CAttackingFactory attacking = CAttackingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* ALeader = attacking.createLeader();
     CUnit* DLeader = defending.createLeader();
     CUnit* AInfantry = attacking.createInfantry();
     CUnit* DInfantry = defending.createInfantry();
     CUnit* AShooter = attacking.createShooter();
     CUnit* DShooter = defending.createShooter();
-    CPlayingBoard::placeUnit(0, 1, ALeader);
-    CPlayingBoard::placeUnit(0, 2, AInfantry);
-    CPlayingBoard::placeUnit(0, 3, AShooter);
-    CPlayingBoard::placeUnit(1, 2, DLeader);
-    CPlayingBoard::placeUnit(1, 3, DInfantry);
-    CPlayingBoard::placeUnit(4, 3, DShooter);
-
-    ASSERT_TRUE(CPlayingBoard::canMove(0, 1, 0, 0));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 1, 0, 2));
-    ASSERT_TRUE(CPlayingBoard::canMove(0, 1, 1, 0));
-    ASSERT_TRUE(CPlayingBoard::canMove(0, 1, 1, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 1, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 2, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 2, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 2, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 2, 1, 2));
-    ASSERT_TRUE(CPlayingBoard::canMove(0, 2, 1, 1));
-
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 0, 0));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 0, 3));
-    ASSERT_TRUE(CPlayingBoard::canMove(0, 3, 0, 4));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 1, 4));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(0, 3, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 1, 2));
-    ASSERT_TRUE(CPlayingBoard::canMove(1, 2, 1, 1));
-    ASSERT_TRUE(CPlayingBoard::canMove(1, 2, 2, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 2, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 1, 3));
-    ASSERT_TRUE(CPlayingBoard::canMove(1, 3, 1, 4));
-    ASSERT_TRUE(CPlayingBoard::canMove(1, 3, 2, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(1, 3, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canMove(4, 3, 4, 3));
-    ASSERT_TRUE(CPlayingBoard::canMove(4, 3, 4, 2));
-
-    CPlayingBoard::deleteBoard();
+    playingBoard.placeUnit(0, 1, ALeader);
+    playingBoard.placeUnit(0, 2, AInfantry);
+    playingBoard.placeUnit(0, 3, AShooter);
+    playingBoard.placeUnit(1, 2, DLeader);
+    playingBoard.placeUnit(1, 3, DInfantry);
+    playingBoard.placeUnit(4, 3, DShooter);
+
+    ASSERT_TRUE(playingBoard.canMove(0, 1, 0, 0));
+    ASSERT_FALSE(playingBoard.canMove(0, 1, 0, 2));
+    ASSERT_TRUE(playingBoard.canMove(0, 1, 1, 0));
+    ASSERT_TRUE(playingBoard.canMove(0, 1, 1, 1));
+    ASSERT_FALSE(playingBoard.canMove(0, 1, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canMove(0, 2, 0, 3));
+    ASSERT_FALSE(playingBoard.canMove(0, 2, 0, 1));
+    ASSERT_FALSE(playingBoard.canMove(0, 2, 0, 2));
+    ASSERT_FALSE(playingBoard.canMove(0, 2, 1, 2));
+    ASSERT_TRUE(playingBoard.canMove(0, 2, 1, 1));
+
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 0, 0));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 0, 1));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 0, 3));
+    ASSERT_TRUE(playingBoard.canMove(0, 3, 0, 4));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 1, 4));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 1, 2));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 1, 3));
+    ASSERT_FALSE(playingBoard.canMove(0, 3, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 0, 3));
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 0, 1));
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 0, 2));
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 1, 2));
+    ASSERT_TRUE(playingBoard.canMove(1, 2, 1, 1));
+    ASSERT_TRUE(playingBoard.canMove(1, 2, 2, 2));
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 1, 3));
+    ASSERT_FALSE(playingBoard.canMove(1, 2, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 0, 3));
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 0, 1));
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 1, 2));
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 1, 3));
+    ASSERT_TRUE(playingBoard.canMove(1, 3, 1, 4));
+    ASSERT_TRUE(playingBoard.canMove(1, 3, 2, 2));
+    ASSERT_FALSE(playingBoard.canMove(1, 3, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 0, 1));
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 0, 3));
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 1, 2));
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 1, 3));
+    ASSERT_FALSE(playingBoard.canMove(4, 3, 4, 3));
+    ASSERT_TRUE(playingBoard.canMove(4, 3, 4, 2));
+
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_unit, canAttack) {
+    CPlayingBoard playingBoard;
     CDefendingFactory defending = CDefendingFactory();
     CAttackingFactory attacking = CAttackingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* ALeader = attacking.createLeader();
     CUnit* DLeader = defending.createLeader();
     CUnit* AInfantry = attacking.createInfantry();
     CUnit* DInfantry = defending.createInfantry();
     CUnit* AShooter = attacking.createShooter();
     CUnit* DShooter = defending.createShooter();
-    CPlayingBoard::placeUnit(0, 1, ALeader);
-    CPlayingBoard::placeUnit(0, 2, AInfantry);
-    CPlayingBoard::placeUnit(0, 3, AShooter);
-    CPlayingBoard::placeUnit(1, 2, DLeader);
-    CPlayingBoard::placeUnit(1, 3, DInfantry);
-    CPlayingBoard::placeUnit(4, 3, DShooter);
-
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 1, 0, 0));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 1, 1, 0));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 1, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 1, 0, 2));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 1, 1, 2));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 1, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 1, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 2, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 2, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 2, 0, 2));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 2, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 2, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 2, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 3, 0, 0));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 3, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(0, 3, 0, 3));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 3, 1, 2));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 3, 1, 3));
-    ASSERT_TRUE(CPlayingBoard::canAttack(0, 3, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 1, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 2, 4, 3));
-
-    ASSERT_TRUE(CPlayingBoard::canAttack(1, 3, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 0, 1));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 1, 4));
-    ASSERT_FALSE(CPlayingBoard::canAttack(1, 3, 4, 3));
-
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 0, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 0, 1));
-    ASSERT_TRUE(CPlayingBoard::canAttack(4, 3, 0, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 1, 2));
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 1, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 4, 3));
-    ASSERT_FALSE(CPlayingBoard::canAttack(4, 3, 4, 2));
-
-    CPlayingBoard::deleteBoard();
+    playingBoard.placeUnit(0, 1, ALeader);
+    playingBoard.placeUnit(0, 2, AInfantry);
+    playingBoard.placeUnit(0, 3, AShooter);
+    playingBoard.placeUnit(1, 2, DLeader);
+    playingBoard.placeUnit(1, 3, DInfantry);
+    playingBoard.placeUnit(4, 3, DShooter);
+
+    ASSERT_FALSE(playingBoard.canAttack(0, 1, 0, 0));
+    ASSERT_FALSE(playingBoard.canAttack(0, 1, 1, 0));
+    ASSERT_FALSE(playingBoard.canAttack(0, 1, 0, 1));
+    ASSERT_FALSE(playingBoard.canAttack(0, 1, 0, 2));
+    ASSERT_TRUE(playingBoard.canAttack(0, 1, 1, 2));
+    ASSERT_TRUE(playingBoard.canAttack(0, 1, 1, 3));
+    ASSERT_FALSE(playingBoard.canAttack(0, 1, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canAttack(0, 2, 0, 3));
+    ASSERT_FALSE(playingBoard.canAttack(0, 2, 0, 1));
+    ASSERT_FALSE(playingBoard.canAttack(0, 2, 0, 2));
+    ASSERT_TRUE(playingBoard.canAttack(0, 2, 1, 2));
+    ASSERT_FALSE(playingBoard.canAttack(0, 2, 1, 3));
+    ASSERT_FALSE(playingBoard.canAttack(0, 2, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canAttack(0, 3, 0, 0));
+    ASSERT_FALSE(playingBoard.canAttack(0, 3, 0, 1));
+    ASSERT_FALSE(playingBoard.canAttack(0, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canAttack(0, 3, 0, 3));
+    ASSERT_TRUE(playingBoard.canAttack(0, 3, 1, 2));
+    ASSERT_TRUE(playingBoard.canAttack(0, 3, 1, 3));
+    ASSERT_TRUE(playingBoard.canAttack(0, 3, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 0, 3));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 0, 1));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 0, 2));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 1, 2));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 1, 1));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 1, 3));
+    ASSERT_FALSE(playingBoard.canAttack(1, 2, 4, 3));
+
+    ASSERT_TRUE(playingBoard.canAttack(1, 3, 0, 3));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 0, 1));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 1, 2));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 1, 3));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 1, 4));
+    ASSERT_FALSE(playingBoard.canAttack(1, 3, 4, 3));
+
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 0, 2));
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 0, 1));
+    ASSERT_TRUE(playingBoard.canAttack(4, 3, 0, 3));
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 1, 2));
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 1, 3));
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 4, 3));
+    ASSERT_FALSE(playingBoard.canAttack(4, 3, 4, 2));
+
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_board, move_and_attack_unit) {
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    CPlayingBoard playingBoard;
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
-    CPlayingBoard::placeUnit(3, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(3, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
     ASSERT_TRUE(board->at(3)[3]);
     ASSERT_FALSE(board->at(2)[3]);
-    CPlayingBoard::attack(3, 3, 3, 2);
+    playingBoard.attack(3, 3, 3, 2);
     ASSERT_TRUE(board->at(3)[2]->getHealth() == -1);
     ASSERT_TRUE(board->at(3)[2]->isDead());
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_Node, add_child_remove_child) {
-    CNode topNode = CNode(-1, 1, 1);
-    ASSERT_TRUE(topNode.depth_ == 1);
-    ASSERT_TRUE(topNode.addChild(-1, 2));
-    ASSERT_FALSE(topNode.addChild(1, 2));
-    CNode midNode = *topNode.children_[0].get();
-    ASSERT_TRUE(midNode.depth_ == 2);
-    ASSERT_FALSE(midNode.addChild(-1, 3));
-    ASSERT_TRUE(midNode.addChild(1, 3));
-    CNode downNode = *midNode.children_[0].get();
-    ASSERT_TRUE(downNode.depth_ == 3);
-    ASSERT_FALSE(downNode.addChild(1, 4));
-    ASSERT_FALSE(downNode.addChild(1, 4));
-    ASSERT_FALSE(midNode.removeChild(1, 4));
-    ASSERT_TRUE(midNode.removeChild(1, 3));
-    ASSERT_TRUE(midNode.children_.size() == 0);
-    ASSERT_TRUE(topNode.children_[0]->addChild(1, 4));
-    ASSERT_FALSE(topNode.removeChild(-1, 2));
+    CComposite composite(defending, CBitBoard());
+    int topNode = composite.getTopNode();
+    ASSERT_TRUE(composite.nodes_[topNode].depth_ == 1);
+    int midNode = composite.addNode(topNode, -1, 3);
+    ASSERT_TRUE(midNode != -1);
+    ASSERT_TRUE(composite.addNode(topNode, 1, 2) == -1);
+    ASSERT_TRUE(composite.nodes_[midNode].depth_ == 2);
+    ASSERT_TRUE(composite.addNode(midNode, -1, 4) == -1);
+    int downNode = composite.addNode(midNode, 1, 3);
+    ASSERT_TRUE(downNode != -1);
+    ASSERT_TRUE(composite.nodes_[downNode].depth_ == 3);
+    ASSERT_TRUE(composite.addNode(downNode, 1, 4) == -1);
+    ASSERT_TRUE(composite.addNode(downNode, 1, 4) == -1);
+    ASSERT_FALSE(composite.removeChild(1, 4));
+    ASSERT_TRUE(composite.removeChild(1, 3));
+    ASSERT_TRUE(composite.nodes_[midNode].firstChild_ == -1);
+    ASSERT_TRUE(composite.addNode(midNode, 1, 4) != -1);
+    ASSERT_FALSE(composite.removeChild(-1, 3));
 }
 
 TEST(Correct_Node, get_node) {
-    CNode topNode = CNode(-1, 1, 1);
-    topNode.addChild(-1, 2);
-    topNode.addChild(-1, 3);
-    topNode.children_[0]->addChild(1, 4);
-    ASSERT_TRUE(topNode.getNode(1, 4) != nullptr);
-    ASSERT_TRUE(topNode.getNode(1, 3) == nullptr);
+    CComposite composite(defending, CBitBoard());
+    composite.addNode(composite.getTopNode(), -1, 3);
+    composite.addNode(composite.getNode(-1, 2), 1, 4);
+    ASSERT_TRUE(composite.getNode(1, 4) != -1);
+    ASSERT_TRUE(composite.getNode(1, 3) == -1);
+    ASSERT_TRUE(composite.getParentNode(1, 4) == composite.getNode(-1, 2));
+}
+
+std::vector<int> childrenOf(const CComposite& composite, int node) {
+    std::vector<int> children;
+    for (int child = composite.node(node).getFirstChild(); child != -1; child = composite.node(child).getNextSibling()) {
+        children.push_back(child);
+    }
+    return children;
 }
 
 TEST(Correct_board, composite_build_print_composite) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
-    CComposite attackingComposite(attacking);
-    CComposite defendingComposite(defending);
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
+    CComposite attackingComposite(attacking, playingBoard);
+    CComposite defendingComposite(defending, playingBoard);
     attackingComposite.printComposite(); //checked for correct printing
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_board, composite_get_node_get_parent_node) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
     CUnit* infantryD = defendingFactory.createInfantry();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
-    CPlayingBoard::placeUnit(3, 3, infantryD);
-    CComposite defendingComposite(defending);
-    std::shared_ptr<CNode> top = defendingComposite.topNode_;
-    std::shared_ptr<CNode> mid = top->children_[0];
-    std::shared_ptr<CNode> bottom1 = mid->children_[0];
-    std::shared_ptr<CNode> bottom2 = mid->children_[1];
-    ASSERT_TRUE(defendingComposite.getNode(bottom1->savedComponent_.first, bottom1->savedComponent_.second) == bottom1);
-    ASSERT_TRUE(defendingComposite.getNode(bottom2->savedComponent_.first, bottom2->savedComponent_.second) == bottom2);
-    ASSERT_TRUE(defendingComposite.getParentNode(bottom1->savedComponent_.first, bottom1->savedComponent_.second) == mid);
-    ASSERT_TRUE(defendingComposite.getNode(mid->savedComponent_.first, mid->savedComponent_.second) == mid);
-    ASSERT_TRUE(defendingComposite.getParentNode(mid->savedComponent_.first, mid->savedComponent_.second) == top);
-    ASSERT_TRUE(defendingComposite.getNode(top->savedComponent_.first, top->savedComponent_.second) == top);
-    ASSERT_TRUE(defendingComposite.getParentNode(top->savedComponent_.first, top->savedComponent_.second) == nullptr);
-    CPlayingBoard::deleteBoard();
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(3, 3, infantryD);
+    CComposite defendingComposite(defending, playingBoard);
+    int top = defendingComposite.getTopNode();
+    int mid = childrenOf(defendingComposite, top)[0];
+    int bottom1 = childrenOf(defendingComposite, mid)[0];
+    int bottom2 = childrenOf(defendingComposite, mid)[1];
+    std::pair<int, int> topPair = defendingComposite.node(top).getSavedComponent();
+    std::pair<int, int> midPair = defendingComposite.node(mid).getSavedComponent();
+    std::pair<int, int> bottom1Pair = defendingComposite.node(bottom1).getSavedComponent();
+    std::pair<int, int> bottom2Pair = defendingComposite.node(bottom2).getSavedComponent();
+    ASSERT_TRUE(defendingComposite.getNode(bottom1Pair.first, bottom1Pair.second) == bottom1);
+    ASSERT_TRUE(defendingComposite.getNode(bottom2Pair.first, bottom2Pair.second) == bottom2);
+    ASSERT_TRUE(defendingComposite.getParentNode(bottom1Pair.first, bottom1Pair.second) == mid);
+    ASSERT_TRUE(defendingComposite.getNode(midPair.first, midPair.second) == mid);
+    ASSERT_TRUE(defendingComposite.getParentNode(midPair.first, midPair.second) == top);
+    ASSERT_TRUE(defendingComposite.getNode(topPair.first, topPair.second) == top);
+    ASSERT_TRUE(defendingComposite.getParentNode(topPair.first, topPair.second) == -1);
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_board, composite_adding_deleting_editing) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
     CUnit* infantryD = defendingFactory.createInfantry();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
-    CPlayingBoard::placeUnit(3, 3, infantryD);
-    CComposite defendingComposite(defending);
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(3, 3, infantryD);
+    CComposite defendingComposite(defending, playingBoard);
     ASSERT_TRUE(defendingComposite.addChild(1));
     ASSERT_FALSE(defendingComposite.addChild(2));
     ASSERT_FALSE(defendingComposite.removeChild(-1, 1));
@@ -334,66 +391,1161 @@ TEST(Correct_board, composite_adding_deleting_editing) {
     ASSERT_TRUE(defendingComposite.switchChild(3, 2, 3));
     ASSERT_TRUE(defendingComposite.removeChild(-1, 2));
     ASSERT_TRUE(defendingComposite.addChild(1));
-    std::shared_ptr<CNode> ptr = defendingComposite.topNode_;
-    ASSERT_TRUE(ptr->children_.size() == 2);
-    std::shared_ptr<CNode> mid3 = defendingComposite.topNode_->children_[0];
-    std::shared_ptr<CNode> mid2 = defendingComposite.topNode_->children_[1];
-    ASSERT_TRUE(mid3->children_.size() == 2);
-    ASSERT_TRUE(mid3->savedComponent_.first == -1 && mid3->savedComponent_.second == 3);
-    ASSERT_TRUE(mid2->children_.empty());
-    ASSERT_TRUE(mid2->savedComponent_.first == -1 && mid2->savedComponent_.second == 2);
-    std::shared_ptr<CNode> bottom1 = mid3->children_[0];
-    std::shared_ptr<CNode> bottom2 = mid3->children_[1];
-    ASSERT_TRUE(bottom1->children_.empty());
-    ASSERT_TRUE(bottom2->children_.empty());
-    ASSERT_TRUE(bottom1->savedComponent_.first == 3 && bottom1->savedComponent_.second == 3);
-    ASSERT_TRUE(bottom2->savedComponent_.first == 3 && bottom2->savedComponent_.second == 2);
-    CPlayingBoard::deleteBoard();
+    std::vector<int> ptr = childrenOf(defendingComposite, defendingComposite.getTopNode());
+    ASSERT_TRUE(ptr.size() == 2);
+    int mid3 = ptr[0];
+    int mid2 = ptr[1];
+    ASSERT_TRUE(childrenOf(defendingComposite, mid3).size() == 2);
+    ASSERT_TRUE(defendingComposite.node(mid3).getSavedComponent() == std::make_pair(-1, 3));
+    ASSERT_TRUE(childrenOf(defendingComposite, mid2).empty());
+    ASSERT_TRUE(defendingComposite.node(mid2).getSavedComponent() == std::make_pair(-1, 2));
+    int bottom1 = childrenOf(defendingComposite, mid3)[0];
+    int bottom2 = childrenOf(defendingComposite, mid3)[1];
+    ASSERT_TRUE(childrenOf(defendingComposite, bottom1).empty());
+    ASSERT_TRUE(childrenOf(defendingComposite, bottom2).empty());
+    ASSERT_TRUE(defendingComposite.node(bottom1).getSavedComponent() == std::make_pair(3, 3));
+    ASSERT_TRUE(defendingComposite.node(bottom2).getSavedComponent() == std::make_pair(3, 2));
+    ASSERT_TRUE(defendingComposite.getNode(3, 2) == bottom2 && defendingComposite.getParentNode(3, 2) == mid3);
+    playingBoard.deleteBoard();
 }
 
 TEST(Correct_board, composite_moving) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
     CUnit* infantryD = defendingFactory.createInfantry();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
-    CPlayingBoard::placeUnit(3, 3, infantryD);
-    CComposite defendingComposite(defending);
-    ASSERT_TRUE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(-1, 2), 1, 0));
-    ASSERT_TRUE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(-1, 2), 0, 1));
-    ASSERT_TRUE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(-1, 1), 1, 0));
-    ASSERT_FALSE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(-1, 2), 1, 1));
-    ASSERT_FALSE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(3, 2), 1, 1));
-    ASSERT_TRUE(CPlayingBoard::canMoveComposite(defendingComposite, std::make_pair(3, 3), 1, 1));
-    std::shared_ptr<CNode> top = defendingComposite.topNode_;
-    std::shared_ptr<CNode> mid = top->children_[0];
-    std::shared_ptr<CNode> bottom1 = mid->children_[0];
-    std::shared_ptr<CNode> bottom2 = mid->children_[1];
-    CPlayingBoard::moveComposite(-1, 2, 1, 0, defendingComposite);
-    ASSERT_TRUE(bottom1->getSavedComponent() == std::make_pair(4, 2));
-    ASSERT_TRUE(bottom2->getSavedComponent() == std::make_pair(4, 3));
-    CPlayingBoard::moveComposite(-1, 2, 0, 1, defendingComposite);
-    CPlayingBoard::moveComposite(-1, 2, 1, 1, defendingComposite);
-    ASSERT_TRUE(bottom1->getSavedComponent() == std::make_pair(4, 3));
-    ASSERT_TRUE(bottom2->getSavedComponent() == std::make_pair(4, 4));
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(3, 3, infantryD);
+    CComposite defendingComposite(defending, playingBoard);
+    ASSERT_TRUE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(-1, 2), 1, 0));
+    ASSERT_TRUE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(-1, 2), 0, 1));
+    ASSERT_TRUE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(-1, 1), 1, 0));
+    ASSERT_FALSE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(-1, 2), 1, 1));
+    ASSERT_FALSE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(3, 2), 1, 1));
+    ASSERT_TRUE(playingBoard.canMoveComposite(defendingComposite, std::make_pair(3, 3), 1, 1));
+    int mid = childrenOf(defendingComposite, defendingComposite.getTopNode())[0];
+    int bottom1 = childrenOf(defendingComposite, mid)[0];
+    int bottom2 = childrenOf(defendingComposite, mid)[1];
+    playingBoard.moveComposite(-1, 2, 1, 0, defendingComposite);
+    ASSERT_TRUE(defendingComposite.node(bottom1).getSavedComponent() == std::make_pair(4, 2));
+    ASSERT_TRUE(defendingComposite.node(bottom2).getSavedComponent() == std::make_pair(4, 3));
+    ASSERT_TRUE(defendingComposite.getNode(4, 2) == bottom1 && defendingComposite.getNode(3, 2) == -1);
+    playingBoard.moveComposite(-1, 2, 0, 1, defendingComposite);
+    playingBoard.moveComposite(-1, 2, 1, 1, defendingComposite);
+    ASSERT_TRUE(defendingComposite.node(bottom1).getSavedComponent() == std::make_pair(4, 3));
+    ASSERT_TRUE(defendingComposite.node(bottom2).getSavedComponent() == std::make_pair(4, 4));
+    ASSERT_TRUE(defendingComposite.getNode(4, 3) == bottom1 && defendingComposite.getNode(4, 4) == bottom2);
     defendingComposite.printComposite();
-    CPlayingBoard::deleteBoard();
+    playingBoard.deleteBoard();
 }
 
 TEST(CVisitor, printBoard) {
+    CPlayingBoard playingBoard;
     CAttackingFactory attackingFactory = CAttackingFactory();
     CDefendingFactory defendingFactory = CDefendingFactory();
-    std::shared_ptr<std::vector<std::vector<CUnit*> > > board = CPlayingBoard::board();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
     CUnit* leaderA = attackingFactory.createLeader();
     CUnit* shooterD = defendingFactory.createShooter();
     CUnit* infantryD = defendingFactory.createInfantry();
-    CPlayingBoard::placeUnit(2, 3, leaderA);
-    CPlayingBoard::placeUnit(3, 2, shooterD);
-    CPlayingBoard::placeUnit(3, 3, infantryD);
-    CPlayingBoard::printBoard();
-    CPlayingBoard::deleteBoard();
+    playingBoard.placeUnit(2, 3, leaderA);
+    playingBoard.placeUnit(3, 2, shooterD);
+    playingBoard.placeUnit(3, 3, infantryD);
+    playingBoard.printBoard();
+    playingBoard.deleteBoard();
     ASSERT_TRUE(true); // вывод корректный
-}
\ No newline at end of file
+}
+
+TEST(Correct_bitboard, place_move_attack) {
+    CBitBoard bits;
+    ASSERT_TRUE(bits.occupied() == 0);
+    bits.placeUnit(3, 3, attacking, leader, 6);
+    bits.placeUnit(3, 2, defending, shooter, 1);
+    ASSERT_TRUE(bits.fractionMask_[attacking] == CBitBoard::squareMask(3, 3));
+    ASSERT_TRUE(bits.typeMask_[shooter] == CBitBoard::squareMask(3, 2));
+    ASSERT_FALSE(bits.canPlaceUnit(3, 3));
+    ASSERT_FALSE(bits.canPlaceUnit(8, 0));
+    ASSERT_TRUE(bits.canPlaceUnit(0, 0));
+    ASSERT_TRUE(bits.canMove(3, 3, 5, 3));
+    ASSERT_FALSE(bits.canMove(3, 3, 3, 2));
+    ASSERT_FALSE(bits.canMove(3, 3, 6, 3));
+    ASSERT_TRUE(bits.canAttack(3, 3, 3, 2));
+    ASSERT_TRUE(bits.canAttack(3, 2, 3, 3));
+    ASSERT_FALSE(bits.canAttack(3, 3, 3, 3));
+    bits.attack(3, 3, 3, 2);
+    ASSERT_TRUE(bits.getHealth(3, 2) == -1);
+    bits.removeUnit(3, 2);
+    ASSERT_FALSE(bits.canAttack(3, 3));
+    ASSERT_TRUE(bits.occupied() == CBitBoard::squareMask(3, 3));
+    uint64_t hash = bits.hash();
+    bits.reduceHealth(3, 2, 1); // empty squares are left alone
+    bits.attack(0, 0, 3, 3);
+    ASSERT_TRUE(bits.hash() == hash && bits.getHealth(3, 3) == 6);
+}
+
+TEST(Correct_bitboard, mirrors_playing_board) {
+    CPlayingBoard playingBoard;
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    std::shared_ptr<const std::vector<std::vector<CUnit*> > > board = playingBoard.board();
+    playingBoard.placeUnit(2, 3, attackingFactory.createLeader());
+    playingBoard.placeUnit(3, 2, defendingFactory.createShooter());
+    playingBoard.placeUnit(3, 3, defendingFactory.createInfantry());
+    CComposite defendingComposite(defending, playingBoard);
+    playingBoard.moveComposite(-1, 2, 1, 0, defendingComposite);
+    playingBoard.attack(2, 3, 4, 3);
+    for (int i = 0; i < boardSize; ++i) {
+        for (int l = 0; l < boardSize; ++l) {
+            CUnit* unit = board->at(i)[l];
+            ASSERT_TRUE(playingBoard.bits_.isOccupied(i, l) == (unit != nullptr));
+            if (unit != nullptr) {
+                ASSERT_TRUE(playingBoard.bits_.getFraction(i, l) == unit->getFraction());
+                ASSERT_TRUE(playingBoard.bits_.getWarriorType(i, l) == unit->getWarriorType());
+                ASSERT_TRUE(playingBoard.bits_.getHealth(i, l) == unit->getHealth());
+            }
+        }
+    }
+    board.reset();
+    playingBoard.deleteBoard();
+    ASSERT_TRUE(playingBoard.bits_.occupied() == 0);
+}
+
+void placeTestArmies(CGameState& state) {
+    ASSERT_TRUE(applyAction(state, CAction(placeAction, 0, 0, 0, 0, leader)));
+    for (int i = 0; i < attackingUnits; ++i) {
+        ASSERT_TRUE(applyAction(state, CAction(placeAction, 1, i, 0, 0, i % 2 == 0 ? infantry : shooter)));
+    }
+    ASSERT_TRUE(applyAction(state, CAction(placeAction, 7, 7, 0, 0, leader)));
+    for (int i = 0; i < defendingUnits; ++i) {
+        ASSERT_TRUE(applyAction(state, CAction(placeAction, 6, 7 - i, 0, 0, i % 2 == 0 ? shooter : infantry)));
+    }
+}
+
+TEST(Correct_engine, placement) {
+    CGameState state;
+    ASSERT_TRUE(state.phase() == placementPhase && state.toMove() == attacking);
+    ASSERT_FALSE(applyAction(state, CAction(placeAction, 0, 0, 0, 0, infantry))); // the leader goes first
+    ASSERT_TRUE(legalActions(state).size() == boardSize * boardSize);
+    ASSERT_TRUE(applyAction(state, CAction(placeAction, 0, 0, 0, 0, leader)));
+    ASSERT_FALSE(applyAction(state, CAction(placeAction, 0, 0, 0, 0, infantry)));
+    ASSERT_FALSE(applyAction(state, CAction(placeAction, 0, 1, 0, 0, leader)));
+    CGameState fresh;
+    placeTestArmies(fresh);
+    ASSERT_TRUE(fresh.phase() == editCompositePhase && fresh.toMove() == attacking);
+    ASSERT_TRUE(fresh.composite(attacking).size() == attackingUnits + 1);
+    ASSERT_TRUE(fresh.composite(defending).size() == defendingUnits + 1);
+    ASSERT_TRUE(legalActions(fresh)[0] == CAction(endEditAction));
+}
+
+TEST(Correct_engine, phases_and_value_semantics) {
+    CGameState state;
+    placeTestArmies(state);
+    ASSERT_TRUE(applyAction(state, CAction(addStructureAction, 0, 0, 0, 0, 1)));
+    ASSERT_TRUE(applyAction(state, CAction(switchChildAction, 0, 0, 0, 0, 3)));
+    ASSERT_FALSE(applyAction(state, CAction(switchChildAction, 0, 0, 0, 0, 1)));
+    ASSERT_TRUE(applyAction(state, CAction(endEditAction)));
+    ASSERT_TRUE(state.toMove() == defending);
+    ASSERT_TRUE(applyAction(state, CAction(endEditAction)));
+    ASSERT_TRUE(state.phase() == movePhase && state.toMove() == attacking);
+
+    CGameState copy = state;
+    ASSERT_FALSE(applyAction(copy, CAction(moveAction, -1, 3, 1, 0))); // blocked by the infantry
+    ASSERT_TRUE(applyAction(copy, CAction(moveAction, -1, 3, 0, 1)));
+    ASSERT_TRUE(copy.board().isOccupied(0, 1) && !copy.board().isOccupied(0, 0));
+    ASSERT_TRUE(state.board().isOccupied(0, 0) && state.composite(attacking).getNode(0, 0) != -1);
+    ASSERT_FALSE(applyAction(copy, CAction(moveAction, 0, 1, 0, 1))); // the leader has already moved
+
+    std::vector<CAction> moves = legalActions(state);
+    for (size_t i = 0; i < moves.size(); ++i) {
+        ASSERT_TRUE(moves[i].type == moveAction && isLegalAction(state, moves[i]));
+    }
+}
+
+TEST(Correct_engine, random_games) {
+    unsigned int seed = 7;
+    for (int game = 0; game < 20; ++game) {
+        CGameState state;
+        for (int step = 0; step < 2000 && !isTerminal(state); ++step) {
+            std::vector<CAction> actions = legalActions(state);
+            ASSERT_FALSE(actions.empty());
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (state.phase() == editCompositePhase ? 0 : (seed >> 16) % actions.size());
+            ASSERT_TRUE(applyAction(state, actions[choice]));
+        }
+        if (isTerminal(state)) {
+            ASSERT_TRUE(legalActions(state).empty());
+        }
+    }
+}
+
+std::vector<CAction> bruteForceMoves(const CGameState& state) {
+    std::vector<CAction> moves;
+    const CComposite& composite = state.composite(state.toMove());
+    int top = composite.getTopNode();
+    for (int node = top; node != -1; node = composite.nextInSubtree(top, node)) {
+        if (CBitBoard::nodeMask(composite, node) == 0 || !CPlayingBoard::allUnmovedComposite(composite, node)) {
+            continue;
+        }
+        std::pair<int, int> nodePair = composite.node(node).getSavedComponent();
+        for (int xOffset = 1 - boardSize; xOffset < boardSize; ++xOffset) {
+            for (int yOffset = 1 - boardSize; yOffset < boardSize; ++yOffset) {
+                if (state.board().canMoveComposite(composite, nodePair, xOffset, yOffset)) {
+                    moves.emplace_back(moveAction, nodePair.first, nodePair.second, xOffset, yOffset);
+                }
+            }
+        }
+    }
+    return moves;
+}
+
+bool actionLess(const CAction& a, const CAction& b) {
+    return std::make_tuple(a.x, a.y, a.targetX, a.targetY) < std::make_tuple(b.x, b.y, b.targetX, b.targetY);
+}
+
+TEST(Correct_movegen, matches_brute_force) {
+    unsigned int seed = 11;
+    int checkedPositions = 0;
+    for (int game = 0; game < 20; ++game) {
+        CGameState state;
+        for (int step = 0; step < 500 && !isTerminal(state); ++step) {
+            std::vector<CAction> actions = legalActions(state);
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (seed >> 16) % actions.size();
+            if (state.phase() == editCompositePhase && (seed >> 8) % 2 == 0) {
+                choice = 0;
+            }
+            if (state.phase() == movePhase) {
+                std::vector<CAction> expected = bruteForceMoves(state);
+                CAction buffer[maxGeneratedMoves];
+                size_t count = state.board().generateMoves(state.composite(state.toMove()), buffer, maxGeneratedMoves);
+                ASSERT_TRUE(count == expected.size());
+                std::vector<CAction> generated(buffer, buffer + count);
+                std::sort(generated.begin(), generated.end(), actionLess);
+                std::sort(expected.begin(), expected.end(), actionLess);
+                ASSERT_TRUE(generated == expected);
+                if (count > 1) {
+                    ASSERT_TRUE(state.board().generateMoves(state.composite(state.toMove()), buffer, 1) == count);
+                }
+                checkedPositions++;
+            }
+            ASSERT_TRUE(applyAction(state, actions[choice]));
+        }
+    }
+    ASSERT_TRUE(checkedPositions > 100);
+}
+
+TEST(Correct_reach, tables_match_units) {
+    for (int f = defending; f <= attacking; ++f) {
+        for (int t = leader; t <= shooter; ++t) {
+            const CUnit* unit = unitPrototype(static_cast<fraction>(f), static_cast<warriorType>(t));
+            for (int from = 0; from < boardSize * boardSize; ++from) {
+                for (int to = 0; to < boardSize * boardSize; ++to) {
+                    int cur_x = from / boardSize, cur_y = from % boardSize;
+                    int new_x = to / boardSize, new_y = to % boardSize;
+                    bool tableMove = (reachTable.move[f][t][from] >> to) & 1;
+                    bool tableAttack = (reachTable.attack[f][t][from] >> to) & 1;
+                    ASSERT_TRUE(tableMove == (from != to && unit->canMove(cur_x, cur_y, new_x, new_y)));
+                    ASSERT_TRUE(tableAttack == (from != to && unit->canAttack(cur_x, cur_y, new_x, new_y)));
+                }
+            }
+        }
+    }
+}
+
+TEST(Correct_bitboard, attack_index) {
+    unsigned int seed = 5;
+    for (int game = 0; game < 20; ++game) {
+        CGameState state;
+        for (int step = 0; step < 500 && !isTerminal(state); ++step) {
+            const CBitBoard& board = state.board();
+            for (int f = defending; f <= attacking; ++f) {
+                uint64_t attackers = 0, targets = 0;
+                for (int x = 0; x < boardSize; ++x) {
+                    for (int y = 0; y < boardSize; ++y) {
+                        for (int i = 0; i < boardSize; ++i) {
+                            for (int l = 0; l < boardSize; ++l) {
+                                if (board.canAttack(x, y, i, l) && board.getFraction(x, y) == f) {
+                                    attackers |= CBitBoard::squareMask(x, y);
+                                    targets |= CBitBoard::squareMask(i, l);
+                                }
+                            }
+                        }
+                    }
+                }
+                ASSERT_TRUE(board.attackers(static_cast<fraction>(f)) == attackers);
+                ASSERT_TRUE(board.targets(static_cast<fraction>(f)) == targets);
+            }
+            std::vector<CAction> actions = legalActions(state);
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (state.phase() == editCompositePhase ? 0 : (seed >> 16) % actions.size());
+            ASSERT_TRUE(applyAction(state, actions[choice]));
+        }
+    }
+}
+
+TEST(Correct_bitboard, unit_storage) {
+    CBitBoard bits;
+    bits.placeUnit(0, 0, attacking, leader, unitStats[attacking][leader].health);
+    bits.placeUnit(0, 1, defending, shooter, unitStats[defending][shooter].health);
+    bits.placeUnit(0, 2, defending, infantry, unitStats[defending][infantry].health);
+    ASSERT_TRUE(bits.aliveUnits() == 7);
+    int shooterId = bits.unitAt(0, 1);
+    ASSERT_TRUE(bits.unit(shooterId).type == shooter && bits.unit(shooterId).fraction == defending);
+    ASSERT_TRUE(bits.unit(shooterId).square == CBitBoard::square(0, 1));
+    bits.attack(0, 1, 0, 0);
+    ASSERT_TRUE(bits.getHealth(0, 0) == unitStats[attacking][leader].health - unitStats[defending][shooter].damage);
+    bits.removeUnit(0, 1);
+    ASSERT_TRUE(bits.unitAt(0, 1) == -1 && bits.aliveUnits() == 5);
+    bits.placeUnit(5, 5, attacking, shooter, unitStats[attacking][shooter].health);
+    ASSERT_TRUE(bits.unitAt(5, 5) == shooterId); // the freed slot is reused
+    CBitBoard snapshot = bits;
+    bits.removeUnit(5, 5);
+    ASSERT_TRUE(snapshot.unitAt(5, 5) == shooterId && snapshot.getHealth(5, 5) == 1);
+}
+
+TEST(Correct_bitboard, ids_follow_moves) {
+    CGameState state;
+    placeTestArmies(state);
+    int leaderId = state.board().unitAt(0, 0);
+    ASSERT_TRUE(applyAction(state, CAction(endEditAction)));
+    ASSERT_TRUE(applyAction(state, CAction(endEditAction)));
+    CAction buffer[maxGeneratedMoves];
+    size_t count = state.board().generateMoves(state.composite(attacking), buffer, maxGeneratedMoves);
+    ASSERT_TRUE(count > 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (buffer[i].x == 0 && buffer[i].y == 0) {
+            ASSERT_TRUE(applyAction(state, buffer[i]));
+            ASSERT_TRUE(state.board().unitAt(buffer[i].targetX, buffer[i].targetY) == leaderId);
+            ASSERT_TRUE(state.board().unit(leaderId).square == CBitBoard::square(buffer[i].targetX, buffer[i].targetY));
+            return;
+        }
+    }
+    FAIL();
+}
+
+TEST(Correct_hash, incremental_matches_rebuild) {
+    unsigned int seed = 11;
+    for (int game = 0; game < 10; ++game) {
+        CGameState state;
+        for (int step = 0; step < 2000 && !isTerminal(state); ++step) {
+            std::vector<CAction> actions = legalActions(state);
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (state.phase() == editCompositePhase ? 0 : (seed >> 16) % actions.size());
+            ASSERT_TRUE(applyAction(state, actions[choice]));
+            ASSERT_TRUE(state.board().hash() == state.board().computeHash());
+        }
+    }
+}
+
+TEST(Correct_hash, transpositions_and_state) {
+    CBitBoard first, second;
+    first.placeUnit(1, 1, attacking, leader, 6);
+    first.placeUnit(5, 5, defending, shooter, 1);
+    second.placeUnit(5, 5, defending, shooter, 1);
+    second.placeUnit(1, 1, attacking, leader, 6);
+    ASSERT_TRUE(first.hash() == second.hash() && first.hash() != 0);
+    second.reduceHealth(1, 1, 2);
+    ASSERT_TRUE(first.hash() != second.hash());
+    first.reduceHealth(1, 1, 2);
+    ASSERT_TRUE(first.hash() == second.hash());
+    first.removeUnit(5, 5);
+    first.removeUnit(1, 1);
+    ASSERT_TRUE(first.hash() == 0);
+
+    CGameState state;
+    uint64_t empty = state.hash();
+    ASSERT_TRUE(applyAction(state, CAction(placeAction, 0, 0, 0, 0, leader)));
+    CGameState other;
+    ASSERT_TRUE(other.hash() == empty && state.hash() != empty);
+
+    CBitBoard board;
+    board.placeUnit(1, 1, attacking, leader, 6);
+    board.placeUnit(1, 2, attacking, infantry, 1);
+    CComposite together(attacking, board), split(attacking, board);
+    ASSERT_TRUE(together.hash() == split.hash() && split.hash() == split.computeHash() && split.hash() != 0);
+    ASSERT_TRUE(split.addChild(1) && split.switchChild(1, 2, 3)); // the same board, other squads
+    ASSERT_TRUE(split.hash() != together.hash() && split.hash() == split.computeHash());
+    split.moveNode(split.getNode(1, 2), 1, 0);
+    ASSERT_TRUE(split.hash() == split.computeHash());
+    split.moveNode(split.getNode(2, 2), -1, 0);
+    ASSERT_TRUE(split.switchChild(1, 2, 2) && split.removeChild(-1, 3) && split.hash() == together.hash());
+}
+
+TEST(Correct_undo, make_unmake_restores_state) {
+    unsigned int seed = 5;
+    int kills = 0;
+    for (int game = 0; game < 6; ++game) {
+        CGameState state;
+        CUndoStack stack(16);
+        std::vector<uint64_t> hashes;
+        std::vector<std::vector<CAction> > played;
+        for (int step = 0; step < 400 && !isTerminal(state); ++step) {
+            std::vector<CAction> actions = legalActions(state);
+            uint64_t hash = state.hash();
+            size_t units = state.composite(attacking).size() + state.composite(defending).size();
+            for (size_t i = 0; i < actions.size(); ++i) {
+                ASSERT_TRUE(makeAction(state, actions[i], stack));
+                unmakeAction(state, stack);
+                ASSERT_TRUE(state.hash() == hash && state.board().hash() == state.board().computeHash());
+                ASSERT_TRUE(state.composite(attacking).size() + state.composite(defending).size() == units);
+                ASSERT_TRUE(legalActions(state) == actions);
+            }
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (seed >> 16) % actions.size();
+            if (state.phase() == editCompositePhase && (seed >> 8) % 2 == 0) {
+                choice = 0;
+            }
+            hashes.push_back(hash);
+            played.push_back(actions);
+            ASSERT_TRUE(makeAction(state, actions[choice], stack));
+            kills += (state.composite(attacking).size() + state.composite(defending).size() < units);
+        }
+        ASSERT_FALSE(makeAction(state, CAction(attackAction, -5, -5), stack));
+        while (stack.size() > 0) {
+            unmakeAction(state, stack);
+            ASSERT_TRUE(state.hash() == hashes.back() && legalActions(state) == played.back());
+            hashes.pop_back();
+            played.pop_back();
+        }
+        ASSERT_TRUE(hashes.empty() && state.phase() == placementPhase && state.board().occupied() == 0);
+        ASSERT_TRUE(state.composite(attacking).size() == 0 && state.composite(defending).size() == 0);
+    }
+    ASSERT_TRUE(kills > 0);
+}
+
+class CPhaseLog: public CPhaseObserver {
+public:
+    std::vector<std::pair<gamePhase, fraction> > phases;
+
+    void onPhaseChange(gamePhase, fraction, gamePhase phase, fraction side) override {
+        phases.emplace_back(phase, side);
+    }
+};
+
+TEST(Correct_game, scripted_game_and_events) {
+    std::istringstream input("1 1\n1\n1 8\n1\n2 8\n1\n3 8\n"   // attacking leader and infantry
+                             "3 1\n1\n7 6\n1\n7 7\n1\n7 8\n"   // defending leader and infantry
+                             "3\n3\n"                          // both keep their composites
+                             "-1 1\n1 0\n-1 1\n1 0\n"          // both armies step down
+                             "4 1\n");                         // the attacking leader hits the defending one
+    std::ostringstream output;
+    std::streambuf* oldInput = std::cin.rdbuf(input.rdbuf());
+    std::streambuf* oldOutput = std::cout.rdbuf(output.rdbuf());
+    CGame game;
+    CPhaseLog log;
+    game.addObserver(&log);
+    game.game();
+    std::cin.rdbuf(oldInput);
+    std::cout.rdbuf(oldOutput);
+    ASSERT_TRUE(isTerminal(game.state()) && game.state().winner() == attacking);
+    ASSERT_TRUE(output.str().find("Attacking team won!") != std::string::npos);
+    std::vector<std::pair<gamePhase, fraction> > expected = {
+            {placementPhase, defending}, {editCompositePhase, attacking}, {editCompositePhase, defending},
+            {movePhase, attacking}, {movePhase, defending}, {attackPhase, attacking}, {finishedPhase, attacking}};
+    ASSERT_TRUE(log.phases == expected);
+}
+
+int minimax(CGameState& state, CUndoStack& stack, int depth, fraction player, int ply) {
+    if (isTerminal(state)) {
+        return state.winner() == player ? winScore - ply : ply - winScore;
+    }
+    if (depth == 0) {
+        return evaluate(state, player);
+    }
+    std::vector<CAction> actions = legalActions(state);
+    if (state.phase() == editCompositePhase) {
+        actions.assign(1, CAction(endEditAction));
+    }
+    int best = (state.toMove() == player ? -winScore - 1 : winScore + 1);
+    for (size_t i = 0; i < actions.size(); ++i) {
+        makeAction(state, actions[i], stack);
+        int score = minimax(state, stack, depth - 1, player, ply + 1);
+        unmakeAction(state, stack);
+        best = (state.toMove() == player ? std::max(best, score) : std::min(best, score));
+    }
+    return best;
+}
+
+TEST(Correct_ai, alpha_beta_matches_minimax) {
+    unsigned int seed = 3;
+    CUndoStack stack;
+    for (int game = 0; game < 4; ++game) {
+        CGameState state;
+        placeTestArmies(state);
+        for (int step = 0; step < 60 && !isTerminal(state); ++step) {
+            ASSERT_TRUE(evaluate(state, attacking) == -evaluate(state, defending));
+            if (state.phase() != editCompositePhase) {
+                CAlphaBetaPlayer player(3);
+                player.chooseAction(state);
+                ASSERT_TRUE(player.lastScore() == minimax(state, stack, 3, state.toMove(), 0));
+            }
+            std::vector<CAction> actions = legalActions(state);
+            seed = seed * 1103515245 + 12345;
+            size_t choice = (state.phase() == editCompositePhase ? 0 : (seed >> 16) % actions.size());
+            ASSERT_TRUE(applyAction(state, actions[choice]));
+        }
+    }
+}
+
+void playToLeaderShot(CGameState& state) { // the attacking shooter may hit the defending leader or an infantry
+    int attackers[4][3] = {{0, 0, leader}, {0, 2, shooter}, {0, 6, infantry}, {0, 7, infantry}};
+    int defenders[4][3] = {{3, 2, leader}, {3, 3, infantry}, {6, 5, infantry}, {6, 7, shooter}};
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(applyAction(state, CAction(placeAction, attackers[i][0], attackers[i][1], 0, 0, attackers[i][2])));
+    }
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(applyAction(state, CAction(placeAction, defenders[i][0], defenders[i][1], 0, 0, defenders[i][2])));
+    }
+    ASSERT_TRUE(applyAction(state, CAction(endEditAction)) && applyAction(state, CAction(endEditAction)));
+    ASSERT_TRUE(applyAction(state, CAction(moveAction, -1, 1, 1, 0)));
+    ASSERT_TRUE(applyAction(state, CAction(moveAction, -1, 1, 1, 0)));
+}
+
+TEST(Correct_ai, kills_the_leader_and_finishes_matches) {
+    CGameState state;
+    playToLeaderShot(state);
+    ASSERT_TRUE(state.phase() == attackPhase && state.attacker() == std::make_pair(1, 2));
+    ASSERT_TRUE(legalActions(state).size() == 2);
+    CAlphaBetaPlayer player(1);
+    ASSERT_TRUE(player.chooseAction(state) == CAction(attackAction, 1, 2, 4, 2));
+    ASSERT_TRUE(player.lastScore() == winScore - 1);
+
+    CGameState match;
+    CAlphaBetaPlayer attackingBot(2, 20000), defendingBot(2, 20000);
+    playMatch(match, attackingBot, defendingBot, 300);
+    ASSERT_TRUE(match.phase() != placementPhase);
+    ASSERT_TRUE(attackingBot.nodes() <= 20000 + maxGeneratedMoves); // each root action may add one node past the budget
+    ASSERT_TRUE(defendingBot.nodes() <= 20000 + maxGeneratedMoves);
+}
+
+TEST(Correct_mcts, finds_the_win_and_respects_the_pool) {
+    CGameState state;
+    playToLeaderShot(state);
+    CMctsPlayer player(300, 2, 4096);
+    ASSERT_TRUE(player.chooseAction(state) == CAction(attackAction, 1, 2, 4, 2));
+    for (int i = 0; i < player.threads(); ++i) {
+        const CMctsTree& tree = player.tree(i);
+        ASSERT_TRUE(tree.node(0).visits == 300 && tree.used() <= 4096);
+        int visits = 0;
+        for (int child = 0; child < tree.node(0).childCount; ++child) {
+            visits += tree.node(tree.node(0).firstChild + child).visits;
+        }
+        ASSERT_TRUE(visits == 300);
+    }
+
+    CGameState match;
+    CMctsPlayer attackingBot(100, 2, 8192, 100), defendingBot(100, 1, 8192, 100);
+    playMatch(match, attackingBot, defendingBot, 200);
+    ASSERT_TRUE(match.phase() != placementPhase);
+}
+
+TEST(Correct_table, store_probe_and_verification) {
+    CTranspositionTable table(1000);
+    ASSERT_TRUE(table.size() == 1024);
+    CTableHit hit;
+    ASSERT_FALSE(table.probe(0x1234, hit));
+    table.store(0x1234, 5, lowerBound, -winScore + 3, 17);
+    ASSERT_TRUE(table.probe(0x1234, hit));
+    ASSERT_TRUE(hit.depth == 5 && hit.bound == lowerBound && hit.score == -winScore + 3 && hit.action == 17);
+    table.store(0x1234, 0, exactBound, 0, -1);
+    ASSERT_TRUE(table.probe(0x1234, hit) && hit.depth == 0 && hit.score == 0 && hit.action == -1);
+    ASSERT_FALSE(table.probe(0x1234 + 1024, hit));
+
+    for (CTranspositionTable::CEntry& entry : table.entries_) { // a torn write leaves data from another store
+        if (entry.data.load() != 0) {
+            entry.data.store(entry.data.load() ^ 1);
+        }
+    }
+    ASSERT_FALSE(table.probe(0x1234, hit));
+    table.clear();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&table, t]() {
+            CTableHit hit;
+            for (uint64_t i = 0; i < 20000; ++i) {
+                uint64_t hash = (i % 64) * 0x9E3779B97F4A7C15ULL;
+                int score = int(hash >> 40) + t; // a hit must belong to its hash, whichever thread stored it
+                table.store(hash, t + 1, exactBound, score, t);
+                if (table.probe(hash, hit)) {
+                    ASSERT_TRUE(hit.score == int(hash >> 40) + hit.action && hit.depth == hit.action + 1);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    CGameState state;
+    playToLeaderShot(state);
+    CAlphaBetaPlayer player(3, 0, &table);
+    ASSERT_TRUE(player.chooseAction(state) == CAction(attackAction, 1, 2, 4, 2));
+    ASSERT_TRUE(player.lastScore() == winScore - 1);
+    ASSERT_TRUE(table.probe(state.hash(), hit) && hit.bound == exactBound && hit.score == winScore - 1);
+    ASSERT_TRUE(legalActions(state)[hit.action] == CAction(attackAction, 1, 2, 4, 2));
+
+    CGameState match; // the table must not change the result of a full-width search
+    placeTestArmies(match);
+    table.clear();
+    for (int step = 0; step < 30 && !isTerminal(match); ++step) {
+        if (match.phase() != editCompositePhase) {
+            CAlphaBetaPlayer plain(3), cached(3, 0, &table);
+            CAction action = plain.chooseAction(match);
+            cached.chooseAction(match);
+            ASSERT_TRUE(cached.lastScore() == plain.lastScore());
+            ASSERT_TRUE(applyAction(match, action));
+        } else {
+            ASSERT_TRUE(applyAction(match, CAction(endEditAction)));
+        }
+    }
+}
+
+TEST(Correct_smp, threads_share_the_table) {
+    CGameState state;
+    playToLeaderShot(state);
+    CLazySmpPlayer player(3, 4);
+    ASSERT_TRUE(player.threads() == 4);
+    ASSERT_TRUE(player.chooseAction(state) == CAction(attackAction, 1, 2, 4, 2));
+    ASSERT_TRUE(player.lastScore() == winScore - 1);
+
+    std::vector<CGameState> suite = searchSuite(4, 7);
+    ASSERT_TRUE(suite.size() == 4);
+    for (size_t i = 0; i < suite.size(); ++i) {
+        ASSERT_TRUE(suite[i].phase() >= movePhase && !isTerminal(suite[i]));
+        CLazySmpPlayer smp(3, 3);
+        CGameState copy = suite[i];
+        ASSERT_TRUE(applyAction(copy, smp.chooseAction(suite[i])));
+        size_t total = 0;
+        for (int thread = 0; thread < smp.threads(); ++thread) {
+            ASSERT_TRUE(smp.nodes(thread) > 0 && smp.seconds(thread) >= 0);
+            total += smp.nodes(thread);
+        }
+        ASSERT_TRUE(total == smp.totalNodes());
+    }
+}
+
+TEST(Correct_timing, deepening_keeps_the_budget) {
+    std::vector<CGameState> suite = searchSuite(3, 11);
+    for (size_t i = 0; i < suite.size(); ++i) {
+        CAlphaBetaPlayer plain(3), deepening(3);
+        deepening.setTimeBudget(1000000);
+        plain.chooseAction(suite[i]);
+        deepening.chooseAction(suite[i]);
+        ASSERT_TRUE(deepening.lastScore() == plain.lastScore() && deepening.lastDepth() <= 3);
+        ASSERT_TRUE(std::abs(plain.lastScore()) >= winScore - 1000 || deepening.lastDepth() == 3);
+
+        CTranspositionTable table(1 << 16);
+        CAlphaBetaPlayer timed(64, 0, &table);
+        timed.setTimeBudget(20);
+        for (int move = 0; move < 3; ++move) {
+            CGameState copy = suite[i];
+            ASSERT_TRUE(applyAction(copy, timed.chooseAction(suite[i])));
+            ASSERT_TRUE(timed.lastDepth() >= 1 && timed.lastSeconds() < 0.5); // generous for loaded machines
+        }
+        ASSERT_TRUE(timed.moves() == 3 && timed.longestSeconds() <= timed.totalSeconds());
+    }
+
+    CGameState state;
+    playToLeaderShot(state);
+    CAlphaBetaPlayer player(64);
+    player.setTimeBudget(50);
+    ASSERT_TRUE(player.chooseAction(state) == CAction(attackAction, 1, 2, 4, 2));
+    ASSERT_TRUE(player.lastDepth() == 1 && player.lastScore() == winScore - 1); // a found win ends the deepening
+}
+
+TEST(Correct_pool, runs_nested_tasks_and_agents) {
+    std::atomic<int> sum(0);
+    {
+        CWorkStealingPool pool(4);
+        ASSERT_TRUE(pool.threads() == 4);
+        for (int i = 0; i < 64; ++i) {
+            pool.submit([&pool, &sum, i]() {
+                for (int j = 0; j < 16; ++j) { // nested tasks land in the worker's own queue and get stolen
+                    pool.submit([&sum, i, j]() {
+                        sum += i * 16 + j;
+                    });
+                }
+            });
+        }
+        pool.wait();
+        ASSERT_TRUE(sum == 1024 * 1023 / 2);
+        pool.submit([&sum]() {
+            sum = -1;
+        });
+    } // the destructor runs what is still queued
+    ASSERT_TRUE(sum == -1);
+
+    std::vector<uint64_t> finalHashes(8, 0);
+    {
+        CWorkStealingPool pool(3);
+        for (int game = 0; game < 8; ++game) {
+            pool.submit([&finalHashes, game]() { // every game owns its state and agents
+                CGameState state;
+                CRandomPlayer randomPlayer(game + 1);
+                CGreedyPlayer greedyPlayer;
+                if (game % 2 == 0 ? playMatch(state, greedyPlayer, randomPlayer, 2000) :
+                    playMatch(state, randomPlayer, greedyPlayer, 2000)) {
+                    finalHashes[game] = state.hash();
+                }
+            });
+        }
+    }
+    for (int game = 0; game < 8; ++game) { // the same games replayed on one thread
+        CGameState state;
+        CRandomPlayer randomPlayer(game + 1);
+        CGreedyPlayer greedyPlayer;
+        ASSERT_TRUE(game % 2 == 0 ? playMatch(state, greedyPlayer, randomPlayer, 2000) :
+                    playMatch(state, randomPlayer, greedyPlayer, 2000));
+        ASSERT_TRUE(finalHashes[game] == state.hash());
+    }
+}
+
+TEST(Correct_config, sizes_and_unit_counts) {
+    CGameConfig config;
+    ASSERT_TRUE(config.boardSide == boardSize && config.units[attacking] == attackingUnits &&
+                config.units[defending] == defendingUnits);
+    std::istringstream file("# a blitz variant\nsize 6\nattacking_units 2 # without the leader\n\ndefending_units 4\n");
+    ASSERT_TRUE(readConfig(file, config));
+    ASSERT_TRUE(config.boardSide == 6 && config.units[attacking] == 2 && config.units[defending] == 4);
+    ASSERT_FALSE(config.set("size", 1) || config.set("colour", 2) || config.set("attacking_units", -1));
+    std::istringstream crowded("size 2\nattacking_units 3\n");
+    CGameConfig small;
+    ASSERT_FALSE(readConfig(crowded, small)); // four attacking units and a defending leader on four squares
+    CGameConfig large;
+    ASSERT_TRUE(large.set("size", 16) && large.fits());
+    ASSERT_THROW(CGameState{large}, std::invalid_argument); // larger sides are for CBattle, the rules keep to boardSize
+
+    CGameState state(config);
+    CRandomPlayer player(7);
+    for (int i = 0; i < 5000 && !isTerminal(state); ++i) {
+        ASSERT_TRUE(applyAction(state, player.chooseAction(state)));
+        ASSERT_TRUE((state.board().occupied() & ~state.board().playable()) == 0);
+        if (state.phase() == editCompositePhase) {
+            ASSERT_TRUE(__builtin_popcountll(state.board().fractionMask(attacking)) <= 3 &&
+                        __builtin_popcountll(state.board().fractionMask(defending)) <= 5);
+        }
+    }
+    ASSERT_TRUE(isTerminal(state));
+}
+
+TEST(Correct_board, large_boards_agree) {
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    CPlayingBoard small(boardSize), square16(16), square32(32), square12(12);
+    CPlayingBoard* boards[4] = {&small, &square16, &square32, &square12};
+    for (int b = 0; b < 4; ++b) {
+        ASSERT_TRUE(b == 0 ? boards[b]->board()->size() == boardSize : boards[b]->board() == nullptr);
+        boards[b]->placeUnit(1, 1, attackingFactory.createLeader());
+        boards[b]->placeUnit(1, 2, attackingFactory.createInfantry());
+        boards[b]->placeUnit(2, 1, attackingFactory.createShooter());
+        boards[b]->placeUnit(5, 5, defendingFactory.createShooter());
+        boards[b]->placeUnit(4, 2, defendingFactory.createLeader());
+    }
+    for (int b = 1; b < 4; ++b) { // every query the rules use, on every square around the units
+        for (int x = 0; x < boardSize; ++x) {
+            for (int y = 0; y < boardSize; ++y) {
+                ASSERT_TRUE(boards[b]->canPlaceUnit(x, y) == small.canPlaceUnit(x, y));
+                ASSERT_TRUE(boards[b]->canAttack(x, y) == small.canAttack(x, y));
+                for (int i = 0; i < boardSize; ++i) {
+                    for (int j = 0; j < boardSize; ++j) {
+                        ASSERT_TRUE(boards[b]->canMove(x, y, i, j) == small.canMove(x, y, i, j));
+                        ASSERT_TRUE(boards[b]->canAttack(x, y, i, j) == small.canAttack(x, y, i, j));
+                    }
+                }
+            }
+        }
+        CComposite smallComposite(attacking, small), largeComposite(attacking, *boards[b]);
+        for (int xOffset = -2; xOffset <= 2; ++xOffset) {
+            for (int yOffset = -2; yOffset <= 2; ++yOffset) {
+                ASSERT_TRUE(boards[b]->canMoveComposite(largeComposite, std::make_pair(-1, 1), xOffset, yOffset) ==
+                            small.canMoveComposite(smallComposite, std::make_pair(-1, 1), xOffset, yOffset));
+            }
+        }
+        ASSERT_TRUE(boards[b]->canPlaceUnit(boards[b]->side() - 1, boards[b]->side() - 1) &&
+                    !boards[b]->canPlaceUnit(boards[b]->side(), 0));
+    }
+    CComposite composite(attacking, square12);
+    square12.moveComposite(-1, 1, 0, 1, composite); // the whole squad, the leader steps onto the infantry's square
+    ASSERT_TRUE(square12.unitAt(1, 2) != nullptr && square12.unitAt(1, 3) != nullptr &&
+                square12.unitAt(2, 2) != nullptr && square12.unitAt(1, 1) == nullptr && composite.getNode(1, 3) != -1);
+    square12.placeUnit(11, 10, defendingFactory.createInfantry());
+    CComposite defendingComposite(defending, square12);
+    square12.moveComposite(11, 10, 0, 1, defendingComposite);
+    ASSERT_TRUE(square12.unitAt(11, 11) != nullptr && defendingComposite.getNode(11, 11) != -1);
+
+    CGameConfig config;
+    config.set("size", 24);
+    config.set("attacking_units", 30);
+    config.set("defending_units", 30);
+    CBattle battle(config, 11);
+    ASSERT_TRUE(battle.army(attacking).size() == 31 && battle.army(defending).size() == 31);
+    while (battle.playRound() && battle.rounds() < 1000) {}
+    ASSERT_TRUE(battle.finished());
+}
+
+TEST(Correct_board, tiled_storage) {
+    CTiledGrid<int> grid(20, -1);
+    ASSERT_TRUE(grid.side() == 20 && grid.get(19, 19) == -1 && grid.allocatedTiles() == 0);
+    grid.set(19, 0, -1); // the empty value needs no tile
+    grid.set(17, 3, 5);
+    grid.set(0, 0, 7);
+    ASSERT_TRUE(grid.allocatedTiles() == 2 && grid.get(17, 3) == 5 && grid.get(17, 4) == -1 && grid.get(0, 0) == 7);
+    int sum = 0;
+    grid.forEach([&sum](int x, int y, int value) {
+        sum += x * 100 + y * 10 + value;
+    });
+    ASSERT_TRUE(sum == 1700 + 30 + 5 + 7);
+    grid.clear();
+    ASSERT_TRUE(grid.allocatedTiles() == 0 && grid.get(17, 3) == -1);
+
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    CPlayingBoard playingBoard(1024);
+    ASSERT_TRUE(playingBoard.board() == nullptr && playingBoard.units_.allocatedTiles() == 0);
+    playingBoard.placeUnit(0, 0, attackingFactory.createLeader());
+    playingBoard.placeUnit(tileSide - 1, tileSide - 1, attackingFactory.createInfantry());
+    playingBoard.placeUnit(1023, 1023, defendingFactory.createLeader());
+    playingBoard.placeUnit(1022, 1023, defendingFactory.createShooter());
+    ASSERT_TRUE(playingBoard.units_.allocatedTiles() == 2);
+    ASSERT_TRUE(playingBoard.unitAt(1023, 1023)->getWarriorType() == leader && playingBoard.unitAt(500, 500) == nullptr);
+    ASSERT_TRUE(!playingBoard.canAttack(1022, 1023) && !playingBoard.canAttack(0, 0));
+    CComposite composite(attacking, playingBoard);
+    ASSERT_TRUE(composite.soldierAt_.allocatedTiles() == 1 && composite.getNode(tileSide - 1, tileSide - 1) != -1);
+    playingBoard.moveComposite(tileSide - 1, tileSide - 1, 1, 1, composite); // into the next tile
+    ASSERT_TRUE(playingBoard.unitAt(tileSide, tileSide) != nullptr && playingBoard.units_.allocatedTiles() == 3);
+    ASSERT_TRUE(composite.getNode(tileSide, tileSide) != -1 && composite.getNode(tileSide - 1, tileSide - 1) == -1);
+    playingBoard.removeUnit(1022, 1023);
+    playingBoard.attack(0, 0, 1023, 1023); // out of reach, only the health changes
+    ASSERT_TRUE(playingBoard.unitAt(1022, 1023) == nullptr && playingBoard.unitAt(1023, 1023)->getHealth() == -1);
+    playingBoard.placeUnit(3, tileSide * 2, defendingFactory.createInfantry());
+    playingBoard.placeUnit(5, 0, defendingFactory.createInfantry()); // an earlier tile, a later row
+    CComposite defendingComposite(defending, playingBoard);
+    std::vector<std::pair<int, int> > soldiers;
+    for (int cur = defendingComposite.getTopNode(); cur != -1;
+         cur = defendingComposite.nextInSubtree(defendingComposite.getTopNode(), cur)) {
+        if (defendingComposite.node(cur).getSavedComponent().first != -1) {
+            soldiers.push_back(defendingComposite.node(cur).getSavedComponent());
+        }
+    }
+    std::vector<std::pair<int, int> > rowOrder = {{3, tileSide * 2}, {5, 0}, {1023, 1023}};
+    ASSERT_TRUE(soldiers == rowOrder);
+    playingBoard.deleteBoard();
+    ASSERT_TRUE(playingBoard.units_.allocatedTiles() == 0 && playingBoard.unitAt(0, 0) == nullptr);
+}
+
+TEST(Correct_board, spatial_index) {
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    CPlayingBoard small(boardSize), large(37);
+    uint64_t seed = 5;
+    for (int i = 0; i < 300; ++i) {
+        CPlayingBoard& board = (i < 20 ? small : large);
+        int x = splitMix64(seed) % board.side(), y = splitMix64(seed) % board.side();
+        if (board.canPlaceUnit(x, y)) {
+            board.placeUnit(x, y, i % 2 == 0 ? attackingFactory.createShooter() : defendingFactory.createInfantry());
+        }
+    }
+    CComposite composite(attacking, large);
+    for (int i = 0; i < 40; ++i) { // the index follows moves and deaths
+        int x = splitMix64(seed) % large.side(), y = splitMix64(seed) % large.side();
+        if (large.unitAt(x, y) != nullptr && large.unitAt(x, y)->getFraction() == defending) {
+            large.removeUnit(x, y);
+        } else if (composite.getNode(x, y) != -1) {
+            large.moveComposite(x, y, 0, 1, composite);
+        }
+    }
+    ASSERT_TRUE(large.large_->index().size() > 0);
+    std::vector<std::pair<int, int> > found;
+    for (int b = 0; b < 2; ++b) {
+        CPlayingBoard& board = (b == 0 ? small : large);
+        for (int x = 0; x < board.side(); ++x) {
+            for (int y = 0; y < board.side(); ++y) {
+                if (board.unitAt(x, y) == nullptr) {
+                    continue;
+                }
+                for (int radius = 0; radius <= 6; ++radius) {
+                    board.enemiesInRadius(x, y, radius, found);
+                    size_t expected = 0;
+                    for (int i = 0; i < board.side(); ++i) {
+                        for (int j = 0; j < board.side(); ++j) {
+                            expected += board.unitAt(i, j) != nullptr && std::abs(i - x) + std::abs(j - y) <= radius &&
+                                        board.unitAt(i, j)->getFraction() != board.unitAt(x, y)->getFraction();
+                        }
+                    }
+                    ASSERT_TRUE(found.size() == expected);
+                    for (size_t i = 0; i < found.size(); ++i) {
+                        ASSERT_TRUE(board.unitAt(found[i].first, found[i].second)->getFraction() !=
+                                    board.unitAt(x, y)->getFraction());
+                    }
+                }
+                bool reachable = false;
+                for (int i = 0; i < board.side(); ++i) {
+                    for (int j = 0; j < board.side(); ++j) {
+                        reachable = reachable || board.canAttack(x, y, i, j);
+                    }
+                }
+                ASSERT_TRUE(board.canAttack(x, y) == reachable);
+            }
+        }
+    }
+}
+
+TEST(Correct_board, composite_move_tracking) {
+    CPlayingBoard playingBoard;
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    playingBoard.placeUnit(1, 1, attackingFactory.createLeader());
+    playingBoard.placeUnit(1, 2, attackingFactory.createInfantry());
+    playingBoard.placeUnit(5, 5, attackingFactory.createShooter());
+    CComposite composite(attacking, playingBoard);
+    int top = composite.getTopNode(), squad = composite.getNode(-1, 2);
+    ASSERT_TRUE(composite.addChild(1) && composite.switchChild(5, 5, 3));
+    playingBoard.moveComposite(1, 2, 0, 1, composite);
+    ASSERT_TRUE(composite.isMoved(composite.getNode(1, 3)) && !composite.isMoved(composite.getNode(1, 1)));
+    ASSERT_TRUE(!composite.allMoved(squad) && !composite.allUnmoved(squad) &&
+                composite.allUnmoved(composite.getNode(-1, 3)));
+    ASSERT_TRUE(composite.movedSoldiers() == CBitBoard::squareMask(1, 3));
+    ASSERT_TRUE(composite.switchChild(1, 3, 3)); // a moved soldier carries its count to the new squad
+    ASSERT_TRUE(composite.allUnmoved(squad) && !composite.allUnmoved(composite.getNode(-1, 3)));
+    playingBoard.moveComposite(-1, 2, 1, 0, composite);
+    ASSERT_TRUE(composite.allMoved(squad) && !composite.allMoved(top));
+    ASSERT_TRUE(composite.removeChild(5, 5) && composite.allMoved(top) &&
+                CPlayingBoard::allMovedComposite(composite, top, 0));
+    composite.startNewMove();
+    ASSERT_TRUE(composite.allUnmoved(top) && composite.movedSoldiers() == 0 &&
+                !composite.isMoved(composite.getNode(2, 1)));
+
+    CGameState state;
+    CRandomPlayer player(3);
+    for (int i = 0; i < 3000 && !isTerminal(state); ++i) { // the counters against a walk over every subtree
+        ASSERT_TRUE(applyAction(state, player.chooseAction(state)));
+        for (int f = 0; f < 2; ++f) {
+            const CComposite& army = state.composite(fraction(f));
+            uint64_t moved = 0;
+            for (int node = army.getTopNode(); node != -1; node = army.nextInSubtree(army.getTopNode(), node)) {
+                bool all = true, none = true;
+                for (int cur = node; cur != -1; cur = army.nextInSubtree(node, cur)) {
+                    if (army.node(cur).getSavedComponent().first != -1) {
+                        all = all && army.isMoved(cur);
+                        none = none && !army.isMoved(cur);
+                    }
+                }
+                ASSERT_TRUE(army.allMoved(node) == all && army.allUnmoved(node) == none);
+                if (army.node(node).getSavedComponent().first != -1 && army.isMoved(node)) {
+                    moved |= CBitBoard::squareMask(army.node(node).getSavedComponent().first,
+                                                   army.node(node).getSavedComponent().second);
+                }
+            }
+            ASSERT_TRUE(army.movedSoldiers() == moved);
+        }
+    }
+}
+
+TEST(Correct_bitboard, squad_shifts) {
+    uint64_t seed = 17;
+    for (int i = 0; i < 2000; ++i) {
+        uint64_t mask = splitMix64(seed) & splitMix64(seed);
+        int xOffset = int(splitMix64(seed) % 17) - 8, yOffset = int(splitMix64(seed) % 17) - 8;
+        uint64_t expected = 0;
+        for (int x = 0; x < boardSize; ++x) {
+            for (int y = 0; y < boardSize; ++y) {
+                if ((mask & CBitBoard::squareMask(x, y)) != 0 && CBitBoard::inside(x + xOffset, y + yOffset)) {
+                    expected |= CBitBoard::squareMask(x + xOffset, y + yOffset);
+                }
+            }
+        }
+        ASSERT_TRUE(CBitBoard::shiftMask(mask, xOffset, yOffset) == expected);
+    }
+
+    CGameConfig config;
+    config.set("size", 7);
+    config.set("attacking_units", 12);
+    config.set("defending_units", 12);
+    CGameState state(config);
+    CRandomPlayer player(9);
+    while (state.phase() == placementPhase) {
+        ASSERT_TRUE(applyAction(state, player.chooseAction(state)));
+    }
+    const CBitBoard& board = state.board();
+    const CComposite& composite = state.composite(attacking);
+    CComposite split = composite; // a soldier, a squad of two and the whole army
+    ASSERT_TRUE(split.addChild(1));
+    for (int i = 0; i < 2; ++i) {
+        std::pair<int, int> soldier = split.node(split.node(split.getNode(-1, 2)).getFirstChild()).getSavedComponent();
+        ASSERT_TRUE(split.switchChild(soldier.first, soldier.second, 3));
+    }
+    for (int s = 0; s < 3; ++s) {
+        const CComposite& army = (s == 0 ? composite : split);
+        int node = (s == 0 ? composite.node(composite.getNode(-1, 2)).getFirstChild() :
+                    s == 1 ? split.getNode(-1, 3) : split.getTopNode());
+        std::pair<int, int> nodePair = army.node(node).getSavedComponent();
+        uint64_t squad = CBitBoard::nodeMask(army, node);
+        for (int xOffset = 1 - boardSize; xOffset < boardSize; ++xOffset) {
+            for (int yOffset = 1 - boardSize; yOffset < boardSize; ++yOffset) {
+                bool fits = true; // every unit on its own: in its ring, on the board, onto a free or squad square
+                for (uint64_t rest = squad; rest != 0; rest &= rest - 1) {
+                    int cur = __builtin_ctzll(rest), x = cur / boardSize, y = cur % boardSize;
+                    int new_x = x + xOffset, new_y = y + yOffset;
+                    fits = fits && board.onBoard(new_x, new_y) &&
+                           (reachTable.move[board.getFraction(x, y)][board.getWarriorType(x, y)][cur] &
+                            CBitBoard::squareMask(new_x, new_y) & ~(board.occupied() & ~squad)) != 0;
+                }
+                ASSERT_TRUE(board.canMoveComposite(army, nodePair, xOffset, yOffset) == fits);
+            }
+        }
+    }
+}
+
+TEST(Correct_board, composite_live_counter) {
+    for (int game = 0; game < 6; ++game) {
+        CGameState state;
+        CRandomPlayer randomPlayer(game + 20);
+        CGreedyPlayer greedyPlayer;
+        CUndoStack undo;
+        for (int i = 0; i < 3000 && !isTerminal(state); ++i) {
+            CPlayer& player = (state.toMove() == attacking) == (game % 2 == 0) ? static_cast<CPlayer&>(greedyPlayer) :
+                                                                                randomPlayer;
+            CAction action = player.chooseAction(state);
+            if (i % 3 == 0) { // the counters also come back with the units
+                ASSERT_TRUE(makeAction(state, action, undo));
+                unmakeAction(state, undo);
+            }
+            ASSERT_TRUE(applyAction(state, action));
+            for (int f = 0; f < 2 && state.phase() != placementPhase; ++f) {
+                const CComposite& army = state.composite(fraction(f));
+                size_t soldiers = 0;
+                for (int node = army.getTopNode(); node != -1; node = army.nextInSubtree(army.getTopNode(), node)) {
+                    soldiers += army.node(node).getSavedComponent().first != -1;
+                }
+                ASSERT_TRUE(army.size() == soldiers &&
+                            soldiers == size_t(__builtin_popcountll(state.board().fractionMask(fraction(f)))));
+            }
+        }
+        ASSERT_TRUE(isTerminal(state));
+    }
+}
+
+TEST(Correct_battle, batched_combat_matches_sequential) {
+    int damage[11] = {2, 1, 3, 1, 2, 1, 1, 1, 1, 2, 3}, targets[11] = {1, 0, 1, 1, 2, 1, 1, 1, 1, 1, 2};
+    std::vector<int> lanes(damageLanes * 3, 0), loss(3, -1);
+    scatterDamage(damage, targets, 11, lanes.data(), 3);
+    sumLanes(lanes.data(), 3, loss.data());
+    ASSERT_TRUE(loss[0] == 1 && loss[1] == 12 && loss[2] == 5);
+    ASSERT_TRUE(std::count(lanes.begin(), lanes.end(), 0) == int(lanes.size()));
+
+    for (int side = 8; side <= 40; side += 16) {
+        CGameConfig config;
+        config.set("size", side);
+        config.set("attacking_units", side * side / 5);
+        config.set("defending_units", side * side / 5);
+        CBattle sequential(config, side), batched(config, side, true);
+        bool playing = true;
+        while (playing && sequential.rounds() < 500) {
+            playing = sequential.playRound();
+            ASSERT_TRUE(batched.playRound() == playing);
+            ASSERT_TRUE(sequential.finished() == batched.finished() && sequential.winner() == batched.winner());
+            for (int x = 0; x < side; ++x) {
+                for (int y = 0; y < side; ++y) {
+                    const CUnit* one = sequential.board().unitAt(x, y);
+                    const CUnit* other = batched.board().unitAt(x, y);
+                    ASSERT_TRUE((one == nullptr) == (other == nullptr));
+                    ASSERT_TRUE(one == nullptr || (one->getHealth() == other->getHealth() &&
+                                                   one->getWarriorType() == other->getWarriorType() &&
+                                                   one->getFraction() == other->getFraction()));
+                }
+            }
+        }
+        ASSERT_TRUE(sequential.finished());
+    }
+}
+
+TEST(Correct_bitboard, threat_maps) {
+    unsigned int seed = 9;
+    int dangers = 0;
+    for (int game = 0; game < 4; ++game) {
+        CGameState state;
+        CUndoStack stack(16);
+        for (int step = 0; step < 300 && !isTerminal(state); ++step) {
+            std::vector<CAction> actions = legalActions(state);
+            seed = seed * 1103515245 + 12345;
+            ASSERT_TRUE(makeAction(state, actions[(seed >> 16) % actions.size()], stack));
+            if (step % 7 == 0) { // the counts survive undo as well
+                unmakeAction(state, stack);
+                ASSERT_TRUE(makeAction(state, actions[(seed >> 16) % actions.size()], stack));
+            }
+            const CBitBoard& board = state.board();
+            for (int f = 0; f < 2; ++f) {
+                uint64_t map = 0;
+                for (int x = 0; x < boardSize; ++x) {
+                    for (int y = 0; y < boardSize; ++y) {
+                        int expected = 0;
+                        for (int i = 0; i < boardSize; ++i) {
+                            for (int j = 0; j < boardSize; ++j) {
+                                if (!board.isOccupied(i, j) || board.getFraction(i, j) != f) {
+                                    continue;
+                                }
+                                CReach reach = unitStats[f][board.getWarriorType(i, j)].attack;
+                                int distance = std::abs(i - x) + std::abs(j - y);
+                                expected += distance >= reach.minDistance && distance <= reach.maxDistance;
+                            }
+                        }
+                        ASSERT_TRUE(board.threatCount(fraction(f), x, y) == expected);
+                        map |= (expected > 0 ? CBitBoard::squareMask(x, y) : 0);
+                    }
+                }
+                ASSERT_TRUE(board.threatMap(fraction(f)) == map);
+            }
+            uint64_t leaders = board.fractionMask(defending) & board.typeMask(leader);
+            ASSERT_TRUE(board.leaderInDanger() == ((leaders & board.threatMap(attacking)) != 0));
+            dangers += board.leaderInDanger();
+        }
+    }
+    ASSERT_TRUE(dangers > 0);
+
+    CAttackingFactory attackingFactory = CAttackingFactory();
+    CDefendingFactory defendingFactory = CDefendingFactory();
+    CPlayingBoard large(20);
+    large.placeUnit(10, 10, defendingFactory.createLeader());
+    ASSERT_FALSE(large.leaderInDanger());
+    uint64_t state = 3;
+    for (int i = 0; i < 120; ++i) {
+        int x = splitMix64(state) % large.side(), y = splitMix64(state) % large.side();
+        if (large.canPlaceUnit(x, y)) {
+            large.placeUnit(x, y, i % 2 == 0 ? attackingFactory.createShooter() : defendingFactory.createInfantry());
+        }
+    }
+    CComposite composite(attacking, large);
+    for (int i = 0; i < 40; ++i) {
+        int x = splitMix64(state) % large.side(), y = splitMix64(state) % large.side();
+        if (large.unitAt(x, y) != nullptr && large.unitAt(x, y)->getFraction() == defending &&
+            large.unitAt(x, y)->getWarriorType() != leader) {
+            large.removeUnit(x, y);
+        } else if (composite.getNode(x, y) != -1) {
+            large.moveComposite(x, y, 0, 1, composite);
+        }
+    }
+    for (int f = 0; f < 2; ++f) {
+        for (int x = -1; x <= large.side(); ++x) {
+            for (int y = -1; y <= large.side(); ++y) {
+                int expected = 0;
+                for (int i = 0; i < large.side(); ++i) {
+                    for (int j = 0; j < large.side(); ++j) {
+                        const CUnit* unit = large.unitAt(i, j);
+                        if (unit == nullptr || unit->getFraction() != f || x < 0 || y < 0 || x == large.side() ||
+                            y == large.side()) {
+                            continue;
+                        }
+                        CReach reach = unitStats[f][unit->getWarriorType()].attack;
+                        int distance = std::abs(i - x) + std::abs(j - y);
+                        expected += distance >= reach.minDistance && distance <= reach.maxDistance;
+                    }
+                }
+                ASSERT_TRUE(large.threatCount(fraction(f), x, y) == expected);
+            }
+        }
+    }
+    ASSERT_TRUE(large.leaderInDanger() == (large.threatCount(attacking, 10, 10) > 0));
+}